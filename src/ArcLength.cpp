@@ -0,0 +1,401 @@
+/************************************************************************
+     File:        ArcLength.cpp
+
+     Comment:     Distance along the track
+
+						See ArcLength.H
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <math.h>
+#include <algorithm>
+
+#include "ArcLength.H"
+#include "Jobs.H"
+#include "Spline.H"
+#include "Track.H"
+
+// 5 point Gauss-Legendre on [-1, 1]
+static const double GL_X[5] = {
+	0, -0.5384693101056831, 0.5384693101056831, -0.9061798459386640, 0.9061798459386640
+};
+static const double GL_W[5] = {
+	0.5688888888888889, 0.4786286704993665, 0.4786286704993665, 0.2369268850561891, 0.2369268850561891
+};
+
+// a piece is good enough when its halves add up to it within this much
+// (relative), and it is split at most this many times
+static const double Arc_Tolerance = 1e-5;
+static const int Arc_Max_Depth = 6;
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+ArcLengthTable::
+ArcLengthTable()
+	: step(0), evaluations(0), builtSpline(Spline_None), builtRevision(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+bool ArcLengthTable::
+update(const std::vector<ControlPoint>& points, const int spline)
+//============================================================================
+{
+	if (!knotU.empty() && spline == builtSpline && samePoints(points, builtPoints))
+		return false;
+
+	build(points, spline);
+	return true;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+bool ArcLengthTable::
+update(const CTrack& track, const int spline)
+//============================================================================
+{
+	if (!knotU.empty() && spline == builtSpline && track.revision == builtRevision)
+		return false;
+
+	build(track.points, spline);
+	builtRevision = track.revision;
+	return true;
+}
+
+//****************************************************************************
+//
+// * the length of segment i from a to b
+//============================================================================
+template <class B>
+static double gauss(const std::vector<ControlPoint>& points, const int i,
+						  const double a, const double b, long& evaluations)
+//============================================================================
+{
+	const double h = (b - a) / 2;
+	const double m = (a + b) / 2;
+
+	double sum = 0;
+	for (int k = 0; k < 5; ++k)
+		sum += GL_W[k] * curveSpeed<B>(points, i, m + h * GL_X[k]);
+	evaluations += 5;
+	return sum * h;
+}
+
+// the knots of one segment, measured from its start
+struct SegmentKnots {
+	std::vector<double>	u, s, v;
+	long						evaluations;
+};
+
+//****************************************************************************
+//
+// * measure [a, b] of the segment by its halves, split again if they don't
+//   agree with the whole, otherwise they become two pieces of the table
+//============================================================================
+template <class B>
+static void split(const std::vector<ControlPoint>& points, const int segment,
+						const double a, const double b, const double whole, const int depth,
+						SegmentKnots& knots)
+//============================================================================
+{
+	const double m = (a + b) / 2;
+	const double left = gauss<B>(points, segment, a, m, knots.evaluations);
+	const double right = gauss<B>(points, segment, m, b, knots.evaluations);
+
+	if (depth < Arc_Max_Depth && fabs(left + right - whole) > Arc_Tolerance * (left + right) + 1e-9)
+	{
+		split<B>(points, segment, a, m, left, depth + 1, knots);
+		split<B>(points, segment, m, b, right, depth + 1, knots);
+		return;
+	}
+
+	const double s = knots.s.back();
+	knots.u.push_back(segment + m);
+	knots.s.push_back(s + left);
+	knots.v.push_back(curveSpeed<B>(points, segment, m));
+
+	knots.u.push_back(segment + b);
+	knots.s.push_back(s + left + right);
+	knots.v.push_back(curveSpeed<B>(points, segment, b));
+
+	knots.evaluations += 2;
+}
+
+//****************************************************************************
+//
+// * the segments don't depend on each other, so they are measured in
+//   parallel (each from 0) and then put one after the other - the table
+//   comes out the same with any number of threads
+//============================================================================
+template <class B>
+void ArcLengthTable::
+measure(const std::vector<ControlPoint>& points)
+//============================================================================
+{
+	const int n = (int) points.size();
+
+	std::vector<SegmentKnots> segments(n);
+	JobPool::shared().parallelFor(n, 256, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i)
+		{
+			SegmentKnots& knots = segments[i];
+			knots.evaluations = 1;
+			knots.u.push_back(i);
+			knots.s.push_back(0);
+			knots.v.push_back(curveSpeed<B>(points, i, 0));
+
+			split<B>(points, i, 0, 1, gauss<B>(points, i, 0, 1, knots.evaluations), 0, knots);
+		}
+	});
+
+	firstKnot.resize(n + 1);
+	double total = 0;
+	for (int i = 0; i < n; ++i)
+	{
+		const SegmentKnots& knots = segments[i];
+		firstKnot[i] = (int) knotU.size();
+		for (size_t k = 0; k < knots.u.size(); ++k)
+		{
+			knotU.push_back(knots.u[k]);
+			knotS.push_back(total + knots.s[k]);
+			knotV.push_back(knots.v[k]);
+		}
+		total += knots.s.back();
+		evaluations += knots.evaluations;
+	}
+	firstKnot[n] = (int) knotU.size();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void ArcLengthTable::
+build(const std::vector<ControlPoint>& points, const int spline)
+//============================================================================
+{
+	const int n = (int) points.size();
+
+	builtPoints = points;
+	builtSpline = spline;
+	builtRevision = 0;
+	evaluations = 0;
+
+	knotU.clear();
+	knotS.clear();
+	knotV.clear();
+	firstKnot.clear();
+	heights.clear();
+	slopes.clear();
+	step = 0;
+
+	if (n == 0)
+		return;
+
+	switch (spline)
+	{
+		case Spline_Linear:		measure<LinearBasis>(points);		break;
+		case Spline_Cardinal:	measure<CatmullRomBasis>(points);	break;
+		case Spline_B_Spline:	measure<BSplineBasis>(points);		break;
+		default:						return;
+	}
+
+	// the heights at even steps of distance, in one batch, then the slope
+	// from the neighbours on both sides
+	const int count = n * Profile_Samples;
+	step = length() / count;
+
+	std::vector<double> t(count);
+	std::vector<Pnt3f> pos(count);
+	heights.resize(count + 1);
+	slopes.resize(count + 1);
+	JobPool::shared().parallelFor(count, 4096, [&](int begin, int end) {
+		for (int k = begin; k < end; ++k)
+			t[k] = parameter(k * step);
+		getCurvesPoints(points, spline, &t[begin], end - begin, &pos[begin], NULL, NULL);
+		for (int k = begin; k < end; ++k)
+			heights[k] = pos[k].y;
+	});
+	evaluations += count;
+	heights[count] = heights[0];
+
+	JobPool::shared().parallelFor(count, 4096, [&](int begin, int end) {
+		for (int k = begin; k < end; ++k)
+		{
+			const float before = heights[(k + count - 1) % count];
+			const float after = heights[k + 1];
+			slopes[k] = step > 0 ? (float) ((after - before) / (2 * step)) : 0;
+		}
+	});
+	slopes[count] = slopes[0];
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+bool ArcLengthTable::
+empty() const
+//============================================================================
+{
+	return knotU.size() < 2;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+double ArcLengthTable::
+length() const
+//============================================================================
+{
+	return knotS.empty() ? 0 : knotS.back();
+}
+
+//****************************************************************************
+//
+// * cubic Hermite through the distances at both knots with the speeds
+//   there as its slopes
+//============================================================================
+double ArcLengthTable::
+hermite(const int k, const double tau, double* slope) const
+//============================================================================
+{
+	const double h = knotU[k + 1] - knotU[k];
+	const double s0 = knotS[k], s1 = knotS[k + 1];
+	const double v0 = knotV[k] * h, v1 = knotV[k + 1] * h;
+	const double t2 = tau * tau, t3 = t2 * tau;
+
+	if (slope)
+		*slope = s0 * (6 * t2 - 6 * tau) + v0 * (3 * t2 - 4 * tau + 1) +
+					s1 * (6 * tau - 6 * t2) + v1 * (3 * t2 - 2 * tau);
+
+	return s0 * (2 * t3 - 3 * t2 + 1) + v0 * (t3 - 2 * t2 + tau) +
+			 s1 * (3 * t2 - 2 * t3) + v1 * (t3 - t2);
+}
+
+//****************************************************************************
+//
+// * find the piece in the segment, then it is the cubic
+//============================================================================
+double ArcLengthTable::
+distance(const double u) const
+//============================================================================
+{
+	if (empty())
+		return 0;
+
+	const int n = (int) firstKnot.size() - 1;
+	double x = fmod(u, (double) n);
+	if (x < 0)
+		x += n;
+
+	int i = (int) x;
+	if (i >= n)
+		i = n - 1;
+
+	const int first = firstKnot[i];
+	const int last = firstKnot[i + 1] - 1;
+	int k = (int) (std::upper_bound(knotU.begin() + first, knotU.begin() + last, x) - knotU.begin()) - 1;
+	if (k < first)
+		k = first;
+	if (k > last - 1)
+		k = last - 1;
+
+	const double h = knotU[k + 1] - knotU[k];
+	return hermite(k, h > 0 ? (x - knotU[k]) / h : 0, NULL);
+}
+
+//****************************************************************************
+//
+// * binary search for the piece, then Newton on its cubic
+//============================================================================
+double ArcLengthTable::
+parameter(const double d) const
+//============================================================================
+{
+	if (empty() || length() <= 0)
+		return 0;
+
+	const double total = knotS.back();
+	double x = fmod(d, total);
+	if (x < 0)
+		x += total;
+
+	const int last = (int) knotS.size() - 1;
+	int k = (int) (std::upper_bound(knotS.begin(), knotS.end(), x) - knotS.begin()) - 1;
+	if (k < 0)
+		k = 0;
+	if (k > last - 1)
+		k = last - 1;
+
+	const double ds = knotS[k + 1] - knotS[k];
+	double tau = ds > 0 ? (x - knotS[k]) / ds : 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		double slope;
+		const double f = hermite(k, tau, &slope) - x;
+		if (slope <= 0)
+			break;
+		tau -= f / slope;
+		if (tau < 0) tau = 0;
+		if (tau > 1) tau = 1;
+	}
+
+	const double u = knotU[k] + tau * (knotU[k + 1] - knotU[k]);
+	return u < firstKnot.size() - 1 ? u : 0;
+}
+
+//****************************************************************************
+//
+// * the profile is evenly spaced, so this is just an index
+//============================================================================
+float ArcLengthTable::
+profile(const std::vector<float>& p, const double d) const
+//============================================================================
+{
+	if (p.size() < 2 || step <= 0)
+		return 0;
+
+	const int count = (int) p.size() - 1;
+	double x = fmod(d / step, (double) count);
+	if (x < 0)
+		x += count;
+
+	int i = (int) x;
+	if (i >= count)
+		i = count - 1;
+	return (float) (p[i] + (x - i) * (p[i + 1] - p[i]));
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+float ArcLengthTable::
+height(const double d) const
+//============================================================================
+{
+	return profile(heights, d);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+float ArcLengthTable::
+slope(const double d) const
+//============================================================================
+{
+	return profile(slopes, d);
+}
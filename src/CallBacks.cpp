@@ -20,18 +20,21 @@
 *************************************************************************/
 #pragma once
 
+#include <stdlib.h>
 #include <time.h>
 #include <math.h>
 
 #include "TrainWindow.H"
 #include "TrainView.H"
 #include "CallBacks.H"
+#include "TrackEdit.H"
 #include "DEBUG.h"
 
 #pragma warning(push)
 #pragma warning(disable:4312)
 #pragma warning(disable:4311)
 #include <Fl/Fl_File_Chooser.H>
+#include <Fl/fl_ask.H>
 #include <Fl/math.h>
 #pragma warning(pop)
 #include <string>
@@ -43,19 +46,35 @@
 void resetCB(Fl_Widget*, TrainWindow* tw)
 //===========================================================================
 {
+	tw->m_Latency.stamp();
 	tw->m_Track.resetPoints();
-	tw->trainView->selectedCube = -1;
-	tw->m_Track.trainU = 0;
-	tw->damageMe();
+	tw->m_History.clear();
+	tw->trainView->select(-1);
+	// we had better put the trains back at the start of the track...
+	tw->m_Sim.rewind(tw->m_Track);
+	tw->damageMe(Dirty_Track | Dirty_Trains);
 }
 
 //***************************************************************************
 //
 // * any time something changes, you need to force a redraw
+//   the buttons that share this callback change different things
 //===========================================================================
-void damageCB(Fl_Widget*, TrainWindow* tw)
+void damageCB(Fl_Widget* w, TrainWindow* tw)
 {
-	tw->damageMe();
+	tw->m_Latency.stamp();
+	unsigned changed = Dirty_All;
+	if (w == tw->worldCam || w == tw->trainCam || w == tw->topCam)
+		changed = Dirty_Camera;
+	else if (w == tw->splineBrowser)
+		changed = Dirty_Spline;
+	else if (w == tw->arcLength)
+		changed = Dirty_Spline | Dirty_Trains;
+	else if (w == tw->physics || w == tw->brakes)
+		changed = Dirty_Trains;
+	else if (w == tw->runButton || w == tw->clearanceButton || w == tw->statsButton)
+		changed = Dirty_None;
+	tw->damageMe(changed);
 }
 
 //***************************************************************************
@@ -66,6 +85,7 @@ void damageCB(Fl_Widget*, TrainWindow* tw)
 void addPointCB(Fl_Widget*, TrainWindow* tw)
 //===========================================================================
 {
+	tw->m_Latency.stamp();
 	// get the number of points
 	size_t npts = tw->m_Track.points.size();
 	// the number for the new point
@@ -75,41 +95,110 @@ void addPointCB(Fl_Widget*, TrainWindow* tw)
 	size_t previdx = (newidx + npts -1) % npts;
 	Pnt3f npos = (tw->m_Track.points[previdx].pos + tw->m_Track.points[newidx].pos) * .5f;
 
-	tw->m_Track.points.insert(tw->m_Track.points.begin() + newidx,npos);
-
-	// make it so that the train doesn't move - unless its affected by this control point
-	// it should stay between the same points
-	if (ceil(tw->m_Track.trainU) > ((float)newidx)) {
-		tw->m_Track.trainU += 1;
-		if (tw->m_Track.trainU >= npts) tw->m_Track.trainU -= npts;
+	tw->m_History.insert(tw->m_Track, (int) newidx, ControlPoint(npos));
+	tw->m_History.commit();
+	// (the points after it moved up one, only the new one stays selected)
+	tw->trainView->select(tw->trainView->selectedCube);
+
+	// make it so that the trains don't move - unless they're affected by this control point
+	// they should stay between the same points
+	for (int t = 0; t < tw->m_Sim.trains(); ++t) {
+		double& u = tw->m_Sim.head[t];
+		if (ceil(u) > ((double)newidx)) {
+			u += 1;
+			if (u >= npts) u -= npts;
+		}
 	}
 
-	tw->damageMe();
+	tw->damageMe(Dirty_Track);
 }
 
 //***************************************************************************
 //
-// * Callback that deletes a point from the spline
+// * Callback that deletes a point from the spline (or all of the
+//   selected ones)
 //===========================================================================
 void deletePointCB(Fl_Widget*, TrainWindow* tw)
 //===========================================================================
 {
-	if (tw->m_Track.points.size() > 4) {
+	tw->m_Latency.stamp();
+	const std::vector<int>& selection = tw->trainView->selection;
+	if (selection.size() > 1) {
+		// all of them as one edit, from the back so the indices hold - as
+		// many as can go with 4 points left
+		for (size_t k = selection.size(); k-- > 0 && tw->m_Track.points.size() > 4; )
+			tw->m_History.erase(tw->m_Track, selection[k]);
+		tw->m_History.commit();
+		tw->trainView->select(-1);
+	}
+	else if (tw->m_Track.points.size() > 4) {
 		if (tw->trainView->selectedCube >= 0) {
-			tw->m_Track.points.erase(tw->m_Track.points.begin() + tw->trainView->selectedCube);
+			tw->m_History.erase(tw->m_Track, tw->trainView->selectedCube);
 		} else
-			tw->m_Track.points.pop_back();
+			tw->m_History.erase(tw->m_Track, (int) tw->m_Track.points.size() - 1);
+		tw->m_History.commit();
 	}
-	tw->damageMe();
+	tw->damageMe(Dirty_Track);
 }
+
+//***************************************************************************
+//
+// * the points go back to what they were before the last edit - only
+//   the pieces of the track around a moved point are built again
+//===========================================================================
+void undoCB(Fl_Widget*, TrainWindow* tw)
+//===========================================================================
+{
+	tw->m_Latency.stamp();
+	if (tw->m_History.undo(tw->m_Track))
+		tw->damageMe(Dirty_Track);
+}
+
+//***************************************************************************
+//
+// *
+//===========================================================================
+void redoCB(Fl_Widget*, TrainWindow* tw)
+//===========================================================================
+{
+	tw->m_Latency.stamp();
+	if (tw->m_History.redo(tw->m_Track))
+		tw->damageMe(Dirty_Track);
+}
+//***************************************************************************
+//
+// * all of the commands are one edit (undo takes them back together), and
+//   the track is built again once
+//===========================================================================
+void editsCB(Fl_Widget*, TrainWindow* tw)
+//===========================================================================
+{
+	const char* fname = 
+		fl_file_chooser("Pick a Command File","*.txt","TrackFiles/");
+	if (!fname)
+		return;
+
+	tw->m_Latency.stamp();
+	TrackEdit edits;
+	const char* why;
+	int line = 0;
+	if (!edits.read(fname, &why, &line) ||
+		 !edits.apply(tw->m_Track, tw->splineBrowser->value(), &tw->m_History, &why, &line)) {
+		fl_alert("%s:%d: %s", fname, line, why);
+		return;
+	}
+	tw->damageMe(Dirty_Track);
+}
+
 //***************************************************************************
 //
 // * Advancing the train
 //===========================================================================
 void forwCB(Fl_Widget*, TrainWindow* tw)
 {
+	tw->m_Latency.stamp();
 	tw->advanceTrain(1);
-	tw->damageMe();
+	tw->damageMe(Dirty_None);
 }
 //***************************************************************************
 //
@@ -118,8 +207,9 @@ void forwCB(Fl_Widget*, TrainWindow* tw)
 void backCB(Fl_Widget*, TrainWindow* tw)
 //===========================================================================
 {
+	tw->m_Latency.stamp();
 	tw->advanceTrain(-1);
-	tw->damageMe();
+	tw->damageMe(Dirty_None);
 }
 
 
@@ -140,7 +230,7 @@ void runButtonCB(TrainWindow* tw)
 		if (clock() - lastRedraw > CLOCKS_PER_SEC/30) {
 			lastRedraw = clock();
 			tw->advanceTrain();
-			tw->damageMe();
+			tw->damageMe(Dirty_None);
 		}
 	}
 }
@@ -155,8 +245,13 @@ void loadCB(Fl_Widget*, TrainWindow* tw)
 	const char* fname = 
 		fl_file_chooser("Pick a Track File","*.txt","TrackFiles/track.txt");
 	if (fname) {
-		tw->m_Track.readPoints(fname);
-		tw->damageMe();
+		const char* why;
+		if (!tw->m_Track.readPoints(fname, &why))
+			fl_alert("%s", why);
+		tw->m_History.clear();
+		tw->m_Sim.rewind(tw->m_Track);
+		tw->m_Latency.stamp();
+		tw->damageMe(Dirty_Track | Dirty_Trains);
 	}
 }
 //***************************************************************************
@@ -168,94 +263,118 @@ void saveCB(Fl_Widget*, TrainWindow* tw)
 {
 	const char* fname = 
 		fl_input("File name for save (should be *.txt)","TrackFiles/");
-	if (fname)
-		tw->m_Track.writePoints(fname);
+	const char* why;
+	if (fname && !tw->m_Track.writePoints(fname, &why))
+		fl_alert("%s", why);
 }
 
 //***************************************************************************
 //
-// * Move the selected control point about x axis
+// * Move the selected control points along the x axis (all of them are
+//   one edit, and the track is built again once)
 //===========================================================================
 void movx(TrainWindow* tw, float dir)
 {
-	int s = tw->trainView->selectedCube;
-	if (s >= 0) {
-		Pnt3f old = tw->m_Track.points[s].pos;
-		tw->m_Track.points[s].pos.x = old.x + dir;
+	tw->m_Latency.stamp();
+	const std::vector<int>& selection = tw->trainView->selection;
+	for (size_t k = 0; k < selection.size(); ++k) {
+		const int s = selection[k];
+		ControlPoint p = tw->m_Track.points[s];
+		p.pos.x += dir;
+		tw->m_History.move(tw->m_Track, s, p);
 	}
-	tw->damageMe();
+	tw->m_History.commit();
+	tw->damageMe(Dirty_Track);
 } 
 
 //***************************************************************************
 //
-// * Move the selected control point about y axis
+// * Move the selected control points along the y axis
 //===========================================================================
 void movy(TrainWindow* tw, float dir)
 {
-	int s = tw->trainView->selectedCube;
-	if (s >= 0) {
-		Pnt3f old = tw->m_Track.points[s].pos;
-		tw->m_Track.points[s].pos.y = old.y + dir;
+	tw->m_Latency.stamp();
+	const std::vector<int>& selection = tw->trainView->selection;
+	for (size_t k = 0; k < selection.size(); ++k) {
+		const int s = selection[k];
+		ControlPoint p = tw->m_Track.points[s];
+		p.pos.y += dir;
+		tw->m_History.move(tw->m_Track, s, p);
 	}
-	tw->damageMe();
+	tw->m_History.commit();
+	tw->damageMe(Dirty_Track);
 } 
 
 //***************************************************************************
 //
-// * Move the selected control point about z axis
+// * Move the selected control points along the z axis
 //===========================================================================
 void movz(TrainWindow* tw, float dir)
 {
-	int s = tw->trainView->selectedCube;
-	if (s >= 0) {
-		Pnt3f old = tw->m_Track.points[s].pos;
-		tw->m_Track.points[s].pos.z = old.z + dir;
+	tw->m_Latency.stamp();
+	const std::vector<int>& selection = tw->trainView->selection;
+	for (size_t k = 0; k < selection.size(); ++k) {
+		const int s = selection[k];
+		ControlPoint p = tw->m_Track.points[s];
+		p.pos.z += dir;
+		tw->m_History.move(tw->m_Track, s, p);
 	}
-	tw->damageMe();
+	tw->m_History.commit();
+	tw->damageMe(Dirty_Track);
 } 
 
 //***************************************************************************
 //
-// * Rotate the selected control point about x axis
+// * Rotate the selected control points about x axis
 //===========================================================================
 void rotx(TrainWindow* tw, float dir)
 {
-	int s = tw->trainView->selectedCube;
-	if (s >= 0) {
-		Pnt3f old = tw->m_Track.points[s].orient;
-		float si = sin(((float)M_PI) * dir / 180.0);
-		float co = cos(((float)M_PI) * dir / 180.0);
-		tw->m_Track.points[s].orient.y = co * old.y - si * old.z;
-		tw->m_Track.points[s].orient.z = si * old.y + co * old.z;
+	tw->m_Latency.stamp();
+	float si = sin(((float)M_PI) * dir / 180.0);
+	float co = cos(((float)M_PI) * dir / 180.0);
+	const std::vector<int>& selection = tw->trainView->selection;
+	for (size_t k = 0; k < selection.size(); ++k) {
+		const int s = selection[k];
+		ControlPoint p = tw->m_Track.points[s];
+		Pnt3f old = p.orient;
+		p.orient.y = co * old.y - si * old.z;
+		p.orient.z = si * old.y + co * old.z;
+		tw->m_History.move(tw->m_Track, s, p);
 	}
-	tw->damageMe();
+	tw->m_History.commit();
+	tw->damageMe(Dirty_Track);
 } 
 
 //***************************************************************************
 //
-// * Rotate the selected control point  about z axis
+// * Rotate the selected control points  about z axis
 //===========================================================================
 void rotz(TrainWindow* tw, float dir)
 //===========================================================================
 {
-	int s = tw->trainView->selectedCube;
-	if (s >= 0) {
-
-		Pnt3f old = tw->m_Track.points[s].orient;
-
-		float si = sin(((float)M_PI) * dir / 180.0);
-		float co = cos(((float)M_PI) * dir / 180.0);
-
-		tw->m_Track.points[s].orient.y = co * old.y - si * old.x;
-		tw->m_Track.points[s].orient.x = si * old.y + co * old.x;
+	tw->m_Latency.stamp();
+	float si = sin(((float)M_PI) * dir / 180.0);
+	float co = cos(((float)M_PI) * dir / 180.0);
+
+	const std::vector<int>& selection = tw->trainView->selection;
+	for (size_t k = 0; k < selection.size(); ++k) {
+		const int s = selection[k];
+		ControlPoint p = tw->m_Track.points[s];
+		Pnt3f old = p.orient;
+
+		p.orient.y = co * old.y - si * old.x;
+		p.orient.x = si * old.y + co * old.x;
+		tw->m_History.move(tw->m_Track, s, p);
 	}
+	tw->m_History.commit();
 
-	tw->damageMe();
+	tw->damageMe(Dirty_Track);
 }
 
 //***************************************************************************
 //
-// * Move the selected control point about x axis by one more unit
+// * Move the selected control points along the x axis (all of them are
+//   one edit, and the track is built again once) by one more unit
 //===========================================================================
 void mxpCB(Fl_Widget*, TrainWindow* tw)
 //===========================================================================
@@ -264,7 +383,8 @@ void mxpCB(Fl_Widget*, TrainWindow* tw)
 }
 //***************************************************************************
 //
-// * Move the selected control point about x axis by one less unit
+// * Move the selected control points along the x axis (all of them are
+//   one edit, and the track is built again once) by one less unit
 //===========================================================================
 void mxnCB(Fl_Widget*, TrainWindow* tw)
 //===========================================================================
@@ -273,7 +393,7 @@ void mxnCB(Fl_Widget*, TrainWindow* tw)
 }
 //***************************************************************************
 //
-// * Move the selected control point about y axis by one more unit
+// * Move the selected control points along the y axis by one more unit
 //===========================================================================
 void mypCB(Fl_Widget*, TrainWindow* tw)
 //===========================================================================
@@ -282,7 +402,7 @@ void mypCB(Fl_Widget*, TrainWindow* tw)
 }
 //***************************************************************************
 //
-// * Move the selected control point about y axis by one less unit
+// * Move the selected control points along the y axis by one less unit
 //===========================================================================
 void mynCB(Fl_Widget*, TrainWindow* tw)
 //===========================================================================
@@ -291,7 +411,7 @@ void mynCB(Fl_Widget*, TrainWindow* tw)
 }
 //***************************************************************************
 //
-// * Move the selected control point about z axis by one more unit
+// * Move the selected control points along the z axis by one more unit
 //===========================================================================
 void mzpCB(Fl_Widget*, TrainWindow* tw)
 //===========================================================================
@@ -300,7 +420,7 @@ void mzpCB(Fl_Widget*, TrainWindow* tw)
 }
 //***************************************************************************
 //
-// * Move the selected control point about z axis by one less unit
+// * Move the selected control points along the z axis by one less unit
 //===========================================================================
 void mznCB(Fl_Widget*, TrainWindow* tw)
 //===========================================================================
@@ -309,7 +429,7 @@ void mznCB(Fl_Widget*, TrainWindow* tw)
 }
 //***************************************************************************
 //
-// * Rotate the selected control point about x axis by one more degree
+// * Rotate the selected control points about x axis by one more degree
 //===========================================================================
 void rxpCB(Fl_Widget*, TrainWindow* tw)
 //===========================================================================
@@ -345,7 +465,18 @@ void rznCB(Fl_Widget*, TrainWindow* tw)
 	rotz(tw, -10);
 }
 
-static char train_amount_buffer[8] = "";
+static char trains_buffer[8] = "";
+
+//***************************************************************************
+// * show the number of cars of the first train
+//===========================================================================
+static void showCars(TrainWindow* tw)
+//===========================================================================
+{
+	char buf[16];
+	sprintf(buf, "%d", tw->m_Sim.cars[0]);
+	tw->carsInput->value(buf);
+}
 
 //***************************************************************************
 // * add one car to train
@@ -353,11 +484,10 @@ static char train_amount_buffer[8] = "";
 void add_trainCB(Fl_Widget*, TrainWindow *tw)
 //===========================================================================
 {
-	if (tw->train_amount < 20) tw->train_amount++;
-	sprintf(train_amount_buffer, "%d", tw->train_amount);
-	tw->trainBox->label(train_amount_buffer);
-	tw->trainBox->redraw_label();
-	tw->damageMe();
+	tw->m_Latency.stamp();
+	tw->m_Sim.setCars(0, tw->m_Sim.cars[0] + 1);
+	showCars(tw);
+	tw->damageMe(Dirty_Trains);
 }
 
 //***************************************************************************
@@ -366,16 +496,144 @@ void add_trainCB(Fl_Widget*, TrainWindow *tw)
 void sub_trainCB(Fl_Widget*, TrainWindow *tw)
 //===========================================================================
 {
-	if (tw->train_amount > 1) tw->train_amount--;
-	sprintf(train_amount_buffer, "%d", tw->train_amount);
-	tw->trainBox->label(train_amount_buffer);
-	tw->trainBox->redraw_label();
-	tw->damageMe();
+	tw->m_Latency.stamp();
+	tw->m_Sim.setCars(0, tw->m_Sim.cars[0] - 1);
+	showCars(tw);
+	tw->damageMe(Dirty_Trains);
+}
+
+//***************************************************************************
+// * the number of cars was typed in
+//===========================================================================
+void carsCB(Fl_Widget*, TrainWindow *tw)
+//===========================================================================
+{
+	tw->m_Latency.stamp();
+	tw->m_Sim.setCars(0, atoi(tw->carsInput->value()));
+	showCars(tw);
+	tw->damageMe(Dirty_Trains);
+}
+
+//***************************************************************************
+// * add another train - it gets the cars of the first train, its own speed
+//   and goes a ways ahead of the last train
+//===========================================================================
+void add_trainsCB(Fl_Widget*, TrainWindow *tw)
+//===========================================================================
+{
+	tw->m_Latency.stamp();
+	TrainSim& sim = tw->m_Sim;
+	const double n = (double) tw->m_Track.points.size();
+	const double u = fmod(sim.head.back() + n * 0.618, n);
+	const float v = (float) tw->speed->value() * (0.5f + (rand() % 100) / 100.0f);
+	sim.addTrain(u, sim.cars[0], v);
+	sprintf(trains_buffer, "%d", sim.trains());
+	tw->trainsBox->label(trains_buffer);
+	tw->trainsBox->redraw_label();
+	tw->damageMe(Dirty_Trains);
+}
+
+//***************************************************************************
+// * remove the last train
+//===========================================================================
+void sub_trainsCB(Fl_Widget*, TrainWindow *tw)
+//===========================================================================
+{
+	tw->m_Latency.stamp();
+	tw->m_Sim.removeTrain();
+	sprintf(trains_buffer, "%d", tw->m_Sim.trains());
+	tw->trainsBox->label(trains_buffer);
+	tw->trainsBox->redraw_label();
+	tw->damageMe(Dirty_Trains);
 }
 
 // RNG
 void rngCB(Fl_Widget*, TrainWindow *tw)
 {
+	tw->m_Latency.stamp();
 	tw->trainView->seed = time(NULL);
+	tw->damageMe(Dirty_Scenery);
+}
+//***************************************************************************
+//
+// * start / stop recording, the recording goes on until the button is
+//   let go (ticks from the run button and from >> / << both count)
+//===========================================================================
+void recordCB(Fl_Widget*, TrainWindow *tw)
+//===========================================================================
+{
+	if (!tw->recordButton->value()) {
+		tw->m_Recorder.stop();
+		if (tw->m_Recorder.dropped)
+			fl_alert("%ld ticks didn't fit in the buffer and weren't recorded",
+						tw->m_Recorder.dropped);
+		return;
+	}
+
+	const char* fname =
+		fl_input("File name for the ride log (should be *.log)", "TrackFiles/ride.log");
+	const char* why;
+	if (!fname || !tw->m_Recorder.start(fname, &why)) {
+		if (fname)
+			fl_alert("%s", why);
+		tw->recordButton->value(0);
+	}
+}
+
+//***************************************************************************
+//
+// * while the replay button is down the recording drives the trains
+//===========================================================================
+void replayCB(Fl_Widget*, TrainWindow *tw)
+//===========================================================================
+{
+	if (!tw->replayButton->value()) {
+		tw->m_Replay.close();
+		tw->m_Latency.stamp();
+		tw->damageMe(Dirty_Trains);
+		return;
+	}
+
+	const char* fname =
+		fl_file_chooser("Pick a Ride Log", "*.log", "TrackFiles/ride.log");
+	const char* why;
+	if (!fname || !tw->m_Replay.open(fname, &why)) {
+		if (fname)
+			fl_alert("%s", why);
+		tw->replayButton->value(0);
+		return;
+	}
+
+	int spline = tw->splineBrowser->value();
+	tw->m_Replay.seek(0, tw->m_Track, spline, tw->m_Sim);
+	tw->m_History.clear();
+	tw->splineBrowser->select(spline);
+	showCars(tw);
+	sprintf(trains_buffer, "%d", tw->m_Sim.trains());
+	tw->trainsBox->label(trains_buffer);
+	tw->trainsBox->redraw_label();
+	tw->m_Latency.stamp();
 	tw->damageMe();
-}
\ No newline at end of file
+}
+
+//***************************************************************************
+//
+// * every frame from now on goes into the file, until the button is let go
+//===========================================================================
+void statsCsvCB(Fl_Widget*, TrainWindow *tw)
+//===========================================================================
+{
+	if (!tw->statsCsvButton->value()) {
+		tw->m_Frames.stopCsv();
+		return;
+	}
+
+	const char* fname =
+		fl_input("File name for the frame statistics (should be *.csv)", "frames.csv");
+	const char* why;
+	if (!fname || !tw->m_Frames.startCsv(fname, &why)) {
+		if (fname)
+			fl_alert("%s", why);
+		tw->statsCsvButton->value(0);
+	}
+}
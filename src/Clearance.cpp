@@ -0,0 +1,539 @@
+/************************************************************************
+     File:        Clearance.cpp
+
+     Comment:     Does the track run into itself?
+
+						See Clearance.H
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <math.h>
+#include <algorithm>
+#include <mutex>
+
+#include "Clearance.H"
+#include "Jobs.H"
+#include "Spline.H"
+#include "TrainSim.H"
+
+static inline float dot(const Pnt3f& a, const Pnt3f& b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static inline float norm(const Pnt3f& a)
+{
+	return sqrt(dot(a, a));
+}
+
+//****************************************************************************
+//
+// * do two boxes overlap - the separating axis test: the 3 axes of each
+//   box and the 9 cross products of an axis of one with one of the other
+//============================================================================
+static bool overlap(const ClearanceBox& a, const ClearanceBox& b)
+//============================================================================
+{
+	const Pnt3f* A[3] = { &a.side, &a.up, &a.dir };
+	const Pnt3f* B[3] = { &b.side, &b.up, &b.dir };
+	const float ea[3] = { a.halfWidth, a.halfHeight, a.halfLength };
+	const float eb[3] = { b.halfWidth, b.halfHeight, b.halfLength };
+
+	float R[3][3], AbsR[3][3];
+	for (int i = 0; i < 3; ++i)
+		for (int j = 0; j < 3; ++j) {
+			R[i][j] = dot(*A[i], *B[j]);
+			// (the epsilon keeps near parallel axes from a false separation)
+			AbsR[i][j] = fabs(R[i][j]) + 1e-5f;
+		}
+
+	const Pnt3f d = b.center + a.center * -1;
+	const float t[3] = { dot(d, *A[0]), dot(d, *A[1]), dot(d, *A[2]) };
+
+	for (int i = 0; i < 3; ++i)
+		if (fabs(t[i]) > ea[i] + eb[0] * AbsR[i][0] + eb[1] * AbsR[i][1] + eb[2] * AbsR[i][2])
+			return false;
+
+	for (int j = 0; j < 3; ++j)
+		if (fabs(t[0] * R[0][j] + t[1] * R[1][j] + t[2] * R[2][j]) >
+			 ea[0] * AbsR[0][j] + ea[1] * AbsR[1][j] + ea[2] * AbsR[2][j] + eb[j])
+			return false;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		const int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+		for (int j = 0; j < 3; ++j)
+		{
+			const int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+			const float ra = ea[i1] * AbsR[i2][j] + ea[i2] * AbsR[i1][j];
+			const float rb = eb[j1] * AbsR[i][j2] + eb[j2] * AbsR[i][j1];
+			if (fabs(t[i2] * R[i1][j] - t[i1] * R[i2][j]) > ra + rb)
+				return false;
+		}
+	}
+	return true;
+}
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+ClearanceChecker::
+ClearanceChecker()
+	: tests(0), spline(-1), revision(0), mergedValid(false)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void ClearanceChecker::
+clear()
+//============================================================================
+{
+	points.clear();
+	spline = -1;
+	revision = 0;
+	boxes.clear();
+	segLength.clear();
+	segStart.clear();
+	hash.clear();
+	overlaps.clear();
+	merged.clear();
+	mergedValid = false;
+}
+
+//****************************************************************************
+//
+// * a point shapes the four segments from two before it to the one after
+//   it (segment i is shaped by points i - 1 to i + 2, see curveSegment),
+//   so those are the ones marked. Away from the edited segments only the
+//   boxes within Clearance_Exclude of them have to be checked again -
+//   further away nothing changed, and the distance along the track to
+//   anything there didn't drop below Clearance_Exclude
+//============================================================================
+int ClearanceChecker::
+update(const CTrack& track, const int type)
+//============================================================================
+{
+	const std::vector<ControlPoint>& now = track.points;
+	const int n = (int) now.size();
+	tests = 0;
+
+	// nothing changed - the points are only looked at after an edit
+	if (track.revision == revision && type == spline && revision != 0)
+		return 0;
+
+	if (n < 2) {
+		clear();
+		return 0;
+	}
+
+	std::vector<char> marked(n, 0);
+	int edited = 0;
+	bool all = type != spline || (int) points.size() != n;
+
+	if (!all)
+	{
+		for (int j = 0; j < n; ++j)
+		{
+			const ControlPoint& a = now[j];
+			const ControlPoint& b = points[j];
+			if (a.pos.x == b.pos.x && a.pos.y == b.pos.y && a.pos.z == b.pos.z &&
+				 a.orient.x == b.orient.x && a.orient.y == b.orient.y && a.orient.z == b.orient.z)
+				continue;
+			for (int s = j - 2; s <= j + 1; ++s)
+			{
+				char& m = marked[(s + n) % n];
+				if (!m) {
+					m = 1;
+					++edited;
+				}
+			}
+		}
+		if (edited == 0) {
+			revision = track.revision;
+			return 0;
+		}
+		// sweeping everything is cheaper than taking most of it apart
+		all = edited > n / 4;
+	}
+
+	if (all)
+	{
+		hash.clear();
+		overlaps.clear();
+		boxes.assign(n, std::vector<ClearanceBox>());
+		segLength.assign(n, 0);
+		JobPool::shared().parallelFor(n, 256, [&](int begin, int end) {
+			for (int i = begin; i < end; ++i)
+				sweep(now, type, i);
+		});
+		for (int i = 0; i < n; ++i)
+			for (size_t k = 0; k < boxes[i].size(); ++k)
+				insert((BoxId) (i * Clearance_Max_Boxes + k));
+		marked.assign(n, 1);
+		edited = n;
+	}
+	else
+	{
+		const std::vector<double> oldLength = segLength;
+		for (int i = 0; i < n; ++i)
+		{
+			if (!marked[i])
+				continue;
+			for (size_t k = 0; k < boxes[i].size(); ++k)
+				remove((BoxId) (i * Clearance_Max_Boxes + k));
+			sweep(now, type, i);
+			for (size_t k = 0; k < boxes[i].size(); ++k)
+				insert((BoxId) (i * Clearance_Max_Boxes + k));
+		}
+
+		// the neighbours, before or after the edit
+		std::vector<char> near = marked;
+		for (int i = 0; i < n; ++i)
+		{
+			if (!marked[i])
+				continue;
+			double gone = 0;
+			for (int j = (i + 1) % n; gone < Clearance_Exclude && j != i; j = (j + 1) % n) {
+				near[j] = 1;
+				gone += std::max(oldLength[j], segLength[j]);
+			}
+			gone = 0;
+			for (int j = (i + n - 1) % n; gone < Clearance_Exclude && j != i; j = (j + n - 1) % n) {
+				near[j] = 1;
+				gone += std::max(oldLength[j], segLength[j]);
+			}
+		}
+		marked.swap(near);
+
+		for (std::set< std::pair<BoxId, BoxId> >::iterator it = overlaps.begin(); it != overlaps.end(); )
+		{
+			if (marked[it->first / Clearance_Max_Boxes] || marked[it->second / Clearance_Max_Boxes])
+				overlaps.erase(it++);
+			else
+				++it;
+		}
+	}
+
+	points = now;
+	revision = track.revision;
+	spline = type;
+
+	segStart.resize(n);
+	double total = 0;
+	for (int i = 0; i < n; ++i) {
+		segStart[i] = total;
+		total += segLength[i];
+	}
+
+	check(marked);
+	mergedValid = false;
+	return edited;
+}
+
+//****************************************************************************
+//
+// * the segment from the points at i and i+1 as a chain of boxes
+//============================================================================
+void ClearanceChecker::
+sweep(const std::vector<ControlPoint>& now, const int type, const int i)
+//============================================================================
+{
+	const ControlPoint* c[4];
+	curveSegment(now, i, c);
+
+	// the control polygon is at least as long as the segment
+	const float around = norm(c[1]->pos + c[0]->pos * -1) + norm(c[2]->pos + c[1]->pos * -1) +
+								norm(c[3]->pos + c[2]->pos * -1);
+	const int count = std::min(Clearance_Max_Boxes, std::max(1, (int) ceil(around / Clearance_Step)));
+
+	std::vector<double> u(count + 1);
+	std::vector<Pnt3f> pos(count + 1), up(count + 1);
+	for (int k = 0; k <= count; ++k)
+		u[k] = i + (double) k / count;
+	getCurvesPoints(now, type, &u[0], count + 1, &pos[0], NULL, &up[0]);
+
+	std::vector<ClearanceBox>& chain = boxes[i];
+	chain.resize(count);
+	float along = 0;
+	Pnt3f dir(1, 0, 0);
+	for (int k = 0; k < count; ++k)
+	{
+		ClearanceBox& box = chain[k];
+		const Pnt3f d = pos[k + 1] + pos[k] * -1;
+		const float l = norm(d);
+		if (l > 0)
+			dir = d * (1 / l);
+
+		// the up of the car, square to the direction
+		Pnt3f v = up[k] + up[k + 1];
+		v = v + dir * -dot(v, dir);
+		if (dot(v, v) < 1e-12f)
+			v = fabs(dir.y) < 0.9f ? Pnt3f(0, 1, 0) + dir * -dir.y : Pnt3f(1, 0, 0) + dir * -dir.x;
+		v.normalize();
+
+		box.dir = dir;
+		box.up = v;
+		box.side = dir * v;
+		box.side.normalize();
+		box.halfWidth = Train_Width / 2;
+		box.halfHeight = Train_Height / 2;
+		box.halfLength = l / 2;
+		box.center = (pos[k] + pos[k + 1]) * 0.5f + v * (Train_Height / 2);
+		box.at = along + l / 2;
+		along += l;
+	}
+	segLength[i] = along;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+const ClearanceBox& ClearanceChecker::
+box(const BoxId id) const
+//============================================================================
+{
+	return boxes[id / Clearance_Max_Boxes][id % Clearance_Max_Boxes];
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+double ClearanceChecker::
+distance(const BoxId id) const
+//============================================================================
+{
+	return segStart[id / Clearance_Max_Boxes] + box(id).at;
+}
+
+//****************************************************************************
+//
+// * every cell the bounds of the box touch
+//============================================================================
+void ClearanceChecker::
+cells(const ClearanceBox& b, std::vector<CellKey>& out) const
+//============================================================================
+{
+	const Pnt3f e(
+		fabs(b.side.x) * b.halfWidth + fabs(b.up.x) * b.halfHeight + fabs(b.dir.x) * b.halfLength,
+		fabs(b.side.y) * b.halfWidth + fabs(b.up.y) * b.halfHeight + fabs(b.dir.y) * b.halfLength,
+		fabs(b.side.z) * b.halfWidth + fabs(b.up.z) * b.halfHeight + fabs(b.dir.z) * b.halfLength);
+
+	const int x0 = (int) floor((b.center.x - e.x) / Clearance_Cell);
+	const int x1 = (int) floor((b.center.x + e.x) / Clearance_Cell);
+	const int y0 = (int) floor((b.center.y - e.y) / Clearance_Cell);
+	const int y1 = (int) floor((b.center.y + e.y) / Clearance_Cell);
+	const int z0 = (int) floor((b.center.z - e.z) / Clearance_Cell);
+	const int z1 = (int) floor((b.center.z + e.z) / Clearance_Cell);
+
+	out.clear();
+	for (int x = x0; x <= x1; ++x)
+		for (int y = y0; y <= y1; ++y)
+			for (int z = z0; z <= z1; ++z)
+				out.push_back((CellKey) ((((unsigned long long) x & 0x1fffff) << 42) |
+												 (((unsigned long long) y & 0x1fffff) << 21) |
+												  ((unsigned long long) z & 0x1fffff)));
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void ClearanceChecker::
+insert(const BoxId id)
+//============================================================================
+{
+	cells(box(id), keys);
+	for (size_t k = 0; k < keys.size(); ++k)
+		hash[keys[k]].push_back(id);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void ClearanceChecker::
+remove(const BoxId id)
+//============================================================================
+{
+	cells(box(id), keys);
+	for (size_t k = 0; k < keys.size(); ++k)
+	{
+		std::unordered_map< CellKey, std::vector<BoxId> >::iterator cell = hash.find(keys[k]);
+		if (cell == hash.end())
+			continue;
+		std::vector<BoxId>& ids = cell->second;
+		std::vector<BoxId>::iterator at = std::find(ids.begin(), ids.end(), id);
+		if (at != ids.end()) {
+			*at = ids.back();
+			ids.pop_back();
+		}
+		if (ids.empty())
+			hash.erase(cell);
+	}
+}
+
+//****************************************************************************
+//
+// * a pair with both boxes marked is only tested from the smaller id (the
+//   other one skips a marked box with a smaller id than its own)
+//============================================================================
+void ClearanceChecker::
+check(const std::vector<char>& marked)
+//============================================================================
+{
+	const double total = length();
+	const int n = (int) boxes.size();
+
+	std::vector<int> segments;
+	for (int i = 0; i < n; ++i)
+		if (marked[i])
+			segments.push_back(i);
+
+	// the hash only gets read, every piece keeps what it found to itself
+	std::mutex found;
+	JobPool::shared().parallelFor((int) segments.size(), 64, [&](int begin, int end) {
+		std::vector<CellKey> keys;
+		std::vector<BoxId> candidates;
+		std::vector< std::pair<BoxId, BoxId> > hits;
+		long tested = 0;
+
+		for (int s = begin; s < end; ++s)
+		{
+			const int i = segments[s];
+			for (size_t k = 0; k < boxes[i].size(); ++k)
+			{
+				const BoxId id = (BoxId) (i * Clearance_Max_Boxes + k);
+				const ClearanceBox& a = boxes[i][k];
+				const double at = segStart[i] + a.at;
+
+				cells(a, keys);
+				candidates.clear();
+				for (size_t c = 0; c < keys.size(); ++c)
+				{
+					std::unordered_map< CellKey, std::vector<BoxId> >::const_iterator cell = hash.find(keys[c]);
+					if (cell != hash.end())
+						candidates.insert(candidates.end(), cell->second.begin(), cell->second.end());
+				}
+				std::sort(candidates.begin(), candidates.end());
+				candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+				for (size_t c = 0; c < candidates.size(); ++c)
+				{
+					const BoxId other = candidates[c];
+					if (other == id || (other < id && marked[other / Clearance_Max_Boxes]))
+						continue;
+
+					double apart = fabs(distance(other) - at);
+					apart = std::min(apart, total - apart);
+					if (apart < Clearance_Exclude)
+						continue;
+
+					++tested;
+					if (overlap(a, box(other)))
+						hits.push_back(std::make_pair(std::min(id, other), std::max(id, other)));
+				}
+			}
+		}
+
+		std::lock_guard<std::mutex> hold(found);
+		overlaps.insert(hits.begin(), hits.end());
+		tests += tested;
+	});
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+double ClearanceChecker::
+length() const
+//============================================================================
+{
+	return segStart.empty() ? 0 : segStart.back() + segLength.back();
+}
+
+//****************************************************************************
+//
+// * overlaps next to each other on both sides become one conflict
+//============================================================================
+const std::vector<ClearanceConflict>& ClearanceChecker::
+conflicts()
+//============================================================================
+{
+	if (mergedValid)
+		return merged;
+	merged.clear();
+
+	struct Pair { double a, b, ha, hb; };
+	std::vector<Pair> pairs;
+	pairs.reserve(overlaps.size());
+	for (std::set< std::pair<BoxId, BoxId> >::const_iterator it = overlaps.begin(); it != overlaps.end(); ++it)
+	{
+		Pair p = { distance(it->first), distance(it->second),
+					  box(it->first).halfLength, box(it->second).halfLength };
+		if (p.a > p.b) {
+			std::swap(p.a, p.b);
+			std::swap(p.ha, p.hb);
+		}
+		pairs.push_back(p);
+	}
+	std::sort(pairs.begin(), pairs.end(), [](const Pair& x, const Pair& y) { return x.a < y.a; });
+
+	const double gap = 2 * Clearance_Step;
+	for (size_t k = 0; k < pairs.size(); ++k)
+	{
+		const Pair& p = pairs[k];
+		size_t r = 0;
+		for (; r < merged.size(); ++r)
+		{
+			const ClearanceConflict& c = merged[r];
+			if (p.a - p.ha <= c.to + gap && p.b + p.hb >= c.otherFrom - gap && p.b - p.hb <= c.otherTo + gap)
+				break;
+		}
+		if (r == merged.size())
+		{
+			ClearanceConflict c = { p.a - p.ha, p.a + p.ha, p.b - p.hb, p.b + p.hb };
+			merged.push_back(c);
+			continue;
+		}
+		ClearanceConflict& c = merged[r];
+		c.from = std::min(c.from, p.a - p.ha);
+		c.to = std::max(c.to, p.a + p.ha);
+		c.otherFrom = std::min(c.otherFrom, p.b - p.hb);
+		c.otherTo = std::max(c.otherTo, p.b + p.hb);
+	}
+
+	mergedValid = true;
+	return merged;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void ClearanceChecker::
+conflictBoxes(std::vector<ClearanceBox>& out) const
+//============================================================================
+{
+	std::vector<BoxId> ids;
+	ids.reserve(overlaps.size() * 2);
+	for (std::set< std::pair<BoxId, BoxId> >::const_iterator it = overlaps.begin(); it != overlaps.end(); ++it) {
+		ids.push_back(it->first);
+		ids.push_back(it->second);
+	}
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+	out.clear();
+	for (size_t k = 0; k < ids.size(); ++k)
+		out.push_back(box(ids[k]));
+}
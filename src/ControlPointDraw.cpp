@@ -0,0 +1,92 @@
+/************************************************************************
+     File:        ControlPointDraw.cpp
+
+     Author:     
+                  Michael Gleicher, gleicher@cs.wisc.edu
+     Modifier
+                  Yu-Chi Lai, yu-chi@cs.wisc.edu
+     
+     Comment:     Drawing a control point
+
+						See ControlPoint.H - this is the part of it that
+						needs OpenGL, so it is only built into the window
+						and the rest stays out of the way of the command
+						line tools
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <windows.h>
+#include <GL/gl.h>
+#include <math.h>
+
+#include "ControlPoint.H"
+#include "Utilities/3dUtils.h"
+
+//****************************************************************************
+//
+// * Draw the control point
+//============================================================================
+void ControlPoint::
+draw()
+//============================================================================
+{
+	float size=2.0;
+
+	glPushMatrix();
+	glTranslatef(pos.x,pos.y,pos.z);
+	float theta1 = -radiansToDegrees(atan2(orient.z,orient.x));
+	glRotatef(theta1,0,1,0);
+	float theta2 = -radiansToDegrees(acos(orient.y));
+	glRotatef(theta2,0,0,1);
+
+		glBegin(GL_QUADS);
+			glNormal3f( 0,0,1);
+			glVertex3f( size, size, size);
+			glVertex3f(-size, size, size);
+			glVertex3f(-size,-size, size);
+			glVertex3f( size,-size, size);
+
+			glNormal3f( 0, 0, -1);
+			glVertex3f( size, size, -size);
+			glVertex3f( size,-size, -size);
+			glVertex3f(-size,-size, -size);
+			glVertex3f(-size, size, -size);
+
+			// no top - it will be the point
+
+			glNormal3f( 0,-1,0);
+			glVertex3f( size,-size, size);
+			glVertex3f(-size,-size, size);
+			glVertex3f(-size,-size,-size);
+			glVertex3f( size,-size,-size);
+
+			glNormal3f( 1,0,0);
+			glVertex3f( size, size, size);
+			glVertex3f( size,-size, size);
+			glVertex3f( size,-size,-size);
+			glVertex3f( size, size,-size);
+
+			glNormal3f(-1,0,0);
+			glVertex3f(-size, size, size);
+			glVertex3f(-size, size,-size);
+			glVertex3f(-size,-size,-size);
+			glVertex3f(-size,-size, size);
+		glEnd();
+		glBegin(GL_TRIANGLE_FAN);
+			glNormal3f(0,1.0f,0);
+			glVertex3f(0,3.0f*size,0);
+			glNormal3f( 1.0f, 0.0f , 1.0f);
+			glVertex3f( size, size , size);
+			glNormal3f(-1.0f, 0.0f , 1.0f);
+			glVertex3f(-size, size , size);
+			glNormal3f(-1.0f, 0.0f ,-1.0f);
+			glVertex3f(-size, size ,-size);
+			glNormal3f( 1.0f, 0.0f ,-1.0f);
+			glVertex3f( size, size ,-size);
+			glNormal3f( 1.0f, 0.0f , 1.0f);
+			glVertex3f( size, size , size);
+		glEnd();
+	glPopMatrix();
+}
\ No newline at end of file
@@ -0,0 +1,343 @@
+/************************************************************************
+     File:        EditHistory.cpp
+
+     Comment:     Undo and redo of the edits of the control points
+
+						See EditHistory.H
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <algorithm>
+
+#include "EditHistory.H"
+
+//****************************************************************************
+//
+// * the same position and orientation
+//============================================================================
+static bool samePoint(const ControlPoint& a, const ControlPoint& b)
+//============================================================================
+{
+	return a.pos.x == b.pos.x && a.pos.y == b.pos.y && a.pos.z == b.pos.z &&
+			 a.orient.x == b.orient.x && a.orient.y == b.orient.y && a.orient.z == b.orient.z;
+}
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+EditHistory::
+EditHistory()
+	: applied(0), edits(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * moving a point the open command moved already just changes where it
+//   went (that is what keeps a drag down to one edit per point)
+//============================================================================
+void EditHistory::
+move(CTrack& track, const int index, const ControlPoint& p)
+//============================================================================
+{
+	if (index < 0 || index >= (int) track.points.size())
+		return;
+
+	recordMove(index, track.points[index], p);
+	track.points[index] = p;
+	track.touch();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void EditHistory::
+recordMove(const int index, const ControlPoint& before, const ControlPoint& after)
+//============================================================================
+{
+	std::unordered_map<int, size_t>::const_iterator m = moved.find(index);
+	if (m != moved.end())
+		open[m->second].after = after;
+	else {
+		PointEdit e;
+		e.kind = PointEdit::Move;
+		e.index = index;
+		e.before = before;
+		e.after = after;
+		record(e);
+		moved[index] = open.size() - 1;
+	}
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void EditHistory::
+insert(CTrack& track, const int index, const ControlPoint& p)
+//============================================================================
+{
+	if (index < 0 || index > (int) track.points.size())
+		return;
+
+	PointEdit e;
+	e.kind = PointEdit::Insert;
+	e.index = index;
+	e.after = p;
+	record(e);
+	moved.clear();
+	apply(track, e, true);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void EditHistory::
+erase(CTrack& track, const int index)
+//============================================================================
+{
+	if (index < 0 || index >= (int) track.points.size())
+		return;
+
+	PointEdit e;
+	e.kind = PointEdit::Erase;
+	e.index = index;
+	e.before = track.points[index];
+	record(e);
+	moved.clear();
+	apply(track, e, true);
+}
+
+//****************************************************************************
+//
+// * the edits are recorded as if they were made one by one, and the
+//   points are then set all at once
+//============================================================================
+void EditHistory::
+replace(CTrack& track, const std::vector<ControlPoint>& points)
+//============================================================================
+{
+	const std::vector<ControlPoint>& old = track.points;
+	const int n = (int) old.size(), m = (int) points.size();
+
+	// what stays the same at the start and at the end
+	int first = 0;
+	while (first < n && first < m && samePoint(old[first], points[first]))
+		++first;
+	int back = 0;
+	while (back < n - first && back < m - first &&
+			 samePoint(old[n - 1 - back], points[m - 1 - back]))
+		++back;
+	if (first == n && first == m)
+		return;
+
+	const int both = std::min(n, m) - first - back;
+	for (int i = first; i < first + both; ++i)
+		if (!samePoint(old[i], points[i]))
+			recordMove(i, old[i], points[i]);
+
+	// the rest of the old ones go, or the rest of the new ones come in
+	const int at = first + both;
+	for (int k = at; k < n - back; ++k) {
+		PointEdit e;
+		e.kind = PointEdit::Erase;
+		e.index = at;
+		e.before = old[k];
+		record(e);
+	}
+	for (int k = at; k < m - back; ++k) {
+		PointEdit e;
+		e.kind = PointEdit::Insert;
+		e.index = k;
+		e.after = points[k];
+		record(e);
+	}
+	if (n != m)
+		moved.clear();
+
+	track.points = points;
+	track.touch();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void EditHistory::
+record(const PointEdit& e)
+//============================================================================
+{
+	// a new edit, what was undone can't come back
+	while (commands.size() > applied) {
+		edits -= (long) commands.back().size();
+		commands.pop_back();
+	}
+	open.push_back(e);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void EditHistory::
+commit()
+//============================================================================
+{
+	if (open.empty())
+		return;
+
+	edits += (long) open.size();
+	commands.push_back(Command());
+	commands.back().swap(open);
+	moved.clear();
+	applied = commands.size();
+
+	// (the newest command stays even if it is bigger than all of them)
+	while (edits > History_Edits && commands.size() > 1) {
+		edits -= (long) commands.front().size();
+		commands.pop_front();
+		--applied;
+	}
+}
+
+//****************************************************************************
+//
+// * an open command is committed first, so it is what is undone
+//============================================================================
+bool EditHistory::
+undo(CTrack& track)
+//============================================================================
+{
+	commit();
+	if (applied == 0)
+		return false;
+
+	const Command& c = commands[--applied];
+	for (size_t k = c.size(); k-- > 0; )
+		apply(track, c[k], false);
+	return true;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+bool EditHistory::
+redo(CTrack& track)
+//============================================================================
+{
+	commit();
+	if (applied == commands.size())
+		return false;
+
+	const Command& c = commands[applied++];
+	for (size_t k = 0; k < c.size(); ++k)
+		apply(track, c[k], true);
+	return true;
+}
+
+//****************************************************************************
+//
+// * make an edit (forward) or take it back
+//============================================================================
+void EditHistory::
+apply(CTrack& track, const PointEdit& e, const bool forward)
+//============================================================================
+{
+	std::vector<ControlPoint>& points = track.points;
+	switch (e.kind)
+	{
+		case PointEdit::Move:
+			points[e.index] = forward ? e.after : e.before;
+			break;
+		case PointEdit::Insert:
+			if (forward)
+				points.insert(points.begin() + e.index, e.after);
+			else
+				points.erase(points.begin() + e.index);
+			break;
+		case PointEdit::Erase:
+			if (forward)
+				points.erase(points.begin() + e.index);
+			else
+				points.insert(points.begin() + e.index, e.before);
+			break;
+	}
+	track.touch();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+bool EditHistory::
+canUndo() const
+//============================================================================
+{
+	return applied > 0 || !open.empty();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+bool EditHistory::
+canRedo() const
+//============================================================================
+{
+	return open.empty() && applied < commands.size();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void EditHistory::
+clear()
+//============================================================================
+{
+	commands.clear();
+	open.clear();
+	moved.clear();
+	applied = 0;
+	edits = 0;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+int EditHistory::
+undoable() const
+//============================================================================
+{
+	return (int) applied + (open.empty() ? 0 : 1);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+int EditHistory::
+redoable() const
+//============================================================================
+{
+	return open.empty() ? (int) (commands.size() - applied) : 0;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+long EditHistory::
+size() const
+//============================================================================
+{
+	return edits + (long) open.size();
+}
@@ -0,0 +1,203 @@
+/************************************************************************
+     File:        FrameStats.cpp
+
+     Comment:     What every frame cost
+
+						See FrameStats.H
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <algorithm>
+
+#include "FrameStats.H"
+#include "Spline.H"
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+FrameStats::
+FrameStats()
+	: next(0), frames(0), curves(curveEvaluations()), csv(0)
+//============================================================================
+{
+	started = ended = Clock::now();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+FrameStats::
+~FrameStats()
+//============================================================================
+{
+	stopCsv();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void FrameStats::
+begin()
+//============================================================================
+{
+	started = Clock::now();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void FrameStats::
+end(const long drawCalls, const long vertices)
+//============================================================================
+{
+	const Clock::time_point now = Clock::now();
+	const long long evaluated = curveEvaluations();
+
+	FrameSample s;
+	s.frame = (float) std::chrono::duration<double, std::milli>(now - ended).count();
+	s.draw = (float) std::chrono::duration<double, std::milli>(now - started).count();
+	s.drawCalls = drawCalls;
+	s.vertices = vertices;
+	s.curvePoints = evaluated - curves;
+
+	if (ring.size() < (size_t) Frame_Stats_Frames)
+		ring.push_back(s);
+	else
+		ring[next] = s;
+	next = (next + 1) % Frame_Stats_Frames;
+
+	if (csv)
+		fprintf(csv, "%ld,%.3f,%.3f,%ld,%ld,%lld\n", frames, s.frame, s.draw,
+				  s.drawCalls, s.vertices, s.curvePoints);
+
+	ended = now;
+	curves = evaluated;
+	++frames;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+int FrameStats::
+count() const
+//============================================================================
+{
+	return (int) ring.size();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+const FrameSample& FrameStats::
+sample(const int back) const
+//============================================================================
+{
+	const int n = (int) ring.size();
+	return ring[((next - 1 - back) % n + n) % n];
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+double FrameStats::
+fps() const
+//============================================================================
+{
+	double total = 0;
+	for (size_t k = 0; k < ring.size(); ++k)
+		total += ring[k].frame;
+	return total > 0 ? 1000.0 * ring.size() / total : 0;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+double FrameStats::
+framePercentile(const double p) const
+//============================================================================
+{
+	return percentile(p, false);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+double FrameStats::
+drawPercentile(const double p) const
+//============================================================================
+{
+	return percentile(p, true);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+double FrameStats::
+percentile(const double p, const bool draw) const
+//============================================================================
+{
+	if (ring.empty())
+		return 0;
+
+	sorted.resize(ring.size());
+	for (size_t k = 0; k < ring.size(); ++k)
+		sorted[k] = draw ? ring[k].draw : ring[k].frame;
+	const size_t k = std::min(sorted.size() - 1, (size_t) (p / 100 * sorted.size()));
+	std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+	return sorted[k];
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+bool FrameStats::
+startCsv(const char* filename, const char** why)
+//============================================================================
+{
+	stopCsv();
+
+	csv = fopen(filename, "w");
+	if (!csv) {
+		if (why) *why = "Can't open the file for writing";
+		return false;
+	}
+	fprintf(csv, "frame,frame_ms,draw_ms,draw_calls,vertices,curve_points\n");
+	return true;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void FrameStats::
+stopCsv()
+//============================================================================
+{
+	if (csv)
+		fclose(csv);
+	csv = 0;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+bool FrameStats::
+writingCsv() const
+//============================================================================
+{
+	return csv != 0;
+}
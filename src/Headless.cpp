@@ -0,0 +1,325 @@
+/************************************************************************
+     File:        Headless.cpp
+
+     Comment:     Offscreen rendering without a window
+
+						See Headless.H for the script commands.
+
+						The TrainWindow is built as usual (so all of the
+						widgets exist and hold the settings) but it is never
+						shown. Instead we make an OSMesa context current and
+						call TrainView::draw ourselves.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <windows.h>
+#include <GL/gl.h>
+#ifdef USE_OSMESA
+#include <GL/osmesa.h>
+#endif
+
+#include "Headless.H"
+#include "TrackEdit.H"
+#include "TrainWindow.H"
+#include "TrainView.H"
+
+#ifdef USE_OSMESA
+
+//****************************************************************************
+//
+// * write the RGBA framebuffer as a binary PPM, GL is bottom up so flip it
+//============================================================================
+static bool writePPM(const char* filename, const unsigned char* rgba, int w, int h)
+//============================================================================
+{
+	FILE* fp = fopen(filename, "wb");
+	if (!fp)
+		return false;
+
+	fprintf(fp, "P6\n%d %d\n255\n", w, h);
+	std::vector<unsigned char> row(w * 3);
+	for (int y = h - 1; y >= 0; --y) {
+		const unsigned char* src = rgba + y * w * 4;
+		for (int x = 0; x < w; ++x) {
+			row[x * 3 + 0] = src[x * 4 + 0];
+			row[x * 3 + 1] = src[x * 4 + 1];
+			row[x * 3 + 2] = src[x * 4 + 2];
+		}
+		fwrite(&row[0], 1, row.size(), fp);
+	}
+	fclose(fp);
+	return true;
+}
+
+//****************************************************************************
+//
+// * (re)bind the offscreen buffer with the given size
+//============================================================================
+static bool makeCurrent(OSMesaContext ctx, std::vector<unsigned char>& buffer, int w, int h)
+//============================================================================
+{
+	buffer.assign(w * h * 4, 0);
+	return OSMesaMakeCurrent(ctx, &buffer[0], GL_UNSIGNED_BYTE, w, h) != 0;
+}
+
+//****************************************************************************
+//
+// * draw a frame, log its timing and write it out
+//============================================================================
+static bool renderFrame(TrainView* tv, FILE* log, const int frame, const double advanceMs,
+								const char* outDir, const std::vector<unsigned char>& buffer, int w, int h)
+//============================================================================
+{
+	std::chrono::high_resolution_clock::time_point t0 = std::chrono::high_resolution_clock::now();
+	tv->draw();
+	glFinish();
+	std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+
+	fprintf(log, "%d,%.3f,%.3f\n", frame, advanceMs,
+			  std::chrono::duration<double, std::milli>(t1 - t0).count());
+
+	char name[1024];
+	snprintf(name, sizeof(name), "%s/frame_%05d.ppm", outDir, frame);
+	if (!writePPM(name, &buffer[0], w, h)) {
+		fprintf(stderr, "Can't write %s\n", name);
+		return false;
+	}
+	return true;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+int runHeadless(const char* script, const char* outDir)
+//============================================================================
+{
+	FILE* fp = fopen(script, "r");
+	if (!fp) {
+		fprintf(stderr, "Can't open script %s\n", script);
+		return 1;
+	}
+
+	char name[1024];
+	snprintf(name, sizeof(name), "%s/timing.csv", outDir);
+	FILE* log = fopen(name, "w");
+	if (!log) {
+		fprintf(stderr, "Can't write %s\n", name);
+		fclose(fp);
+		return 1;
+	}
+	fprintf(log, "frame,advance_ms,draw_ms\n");
+
+	// the window is never shown - it just holds the world and the settings
+	TrainWindow tw;
+	TrainView* tv = tw.trainView;
+	// every frame shows the track as it is, not the one before an edit
+	tv->waitForMeshes = true;
+
+	int width = 640, height = 480;
+	std::vector<unsigned char> buffer;
+
+	OSMesaContext ctx = OSMesaCreateContextExt(OSMESA_RGBA, 24, 8, 0, NULL);
+	if (!ctx || !makeCurrent(ctx, buffer, width, height)) {
+		fprintf(stderr, "Can't create the OSMesa context\n");
+		fclose(log);
+		fclose(fp);
+		return 1;
+	}
+	tv->size(width, height);
+
+	int frame = 0;
+	int line = 0;
+	int result = 0;
+	char buf[512];
+	while (!result && fgets(buf, 512, fp)) {
+		line++;
+		std::vector<const char*> words;
+		breakString(buf, words);
+		if (words.empty())
+			continue;
+
+		const char* cmd = words[0];
+		const char* arg = words.size() > 1 ? words[1] : "";
+		unsigned changed = Dirty_None;		// what the command changed
+
+		if (!strcmp(cmd, "size") && words.size() >= 3) {
+			width = atoi(words[1]);
+			height = atoi(words[2]);
+			if (width <= 0 || height <= 0 || !makeCurrent(ctx, buffer, width, height)) {
+				fprintf(stderr, "%s:%d: bad size\n", script, line);
+				result = 1;
+			}
+			tv->size(width, height);
+		}
+		else if (!strcmp(cmd, "track")) {
+			const char* why;
+			if (!tw.m_Track.readPoints(arg, &why)) {
+				fprintf(stderr, "%s:%d: %s: %s\n", script, line, arg, why);
+				result = 1;
+			}
+			tw.m_Sim.rewind(tw.m_Track);
+			changed = Dirty_Track | Dirty_Trains;
+		}
+		else if (!strcmp(cmd, "camera")) {
+			tw.worldCam->value(!strcmp(arg, "world"));
+			tw.trainCam->value(!strcmp(arg, "train"));
+			tw.topCam->value(!strcmp(arg, "top"));
+			changed = Dirty_Camera;
+		}
+		else if (!strcmp(cmd, "spline")) {
+			if (!strcmp(arg, "linear"))
+				tw.splineBrowser->select(1);
+			else if (!strcmp(arg, "cardinal"))
+				tw.splineBrowser->select(2);
+			else if (!strcmp(arg, "bspline"))
+				tw.splineBrowser->select(3);
+			changed = Dirty_Spline;
+		}
+		else if (!strcmp(cmd, "cars")) {
+			int n = atoi(arg);
+			tw.m_Sim.setCars(0, n);
+			changed = Dirty_Trains;
+		}
+		else if (!strcmp(cmd, "speed")) {
+			tw.speed->value(atof(arg));
+		}
+		else if (!strcmp(cmd, "physics")) {
+			tw.physics->value(atoi(arg));
+		}
+		else if (!strcmp(cmd, "arclength")) {
+			tw.arcLength->value(atoi(arg));
+			changed = Dirty_Spline | Dirty_Trains;
+		}
+		else if (!strcmp(cmd, "record")) {
+			const char* why;
+			if (!tw.m_Recorder.start(arg, &why)) {
+				fprintf(stderr, "%s:%d: %s: %s\n", script, line, arg, why);
+				result = 1;
+			}
+		}
+		else if (!strcmp(cmd, "replay") || !strcmp(cmd, "seek")) {
+			const char* why;
+			int spline = tw.splineBrowser->value();
+			if (!strcmp(cmd, "replay") && !tw.m_Replay.open(arg, &why)) {
+				fprintf(stderr, "%s:%d: %s: %s\n", script, line, arg, why);
+				result = 1;
+			}
+			else if (!tw.m_Replay.seek(!strcmp(cmd, "seek") ? atol(arg) : 0, tw.m_Track, spline, tw.m_Sim)) {
+				fprintf(stderr, "%s:%d: no frame %s to seek to\n", script, line, arg);
+				result = 1;
+			}
+			tw.splineBrowser->select(spline);
+			changed = Dirty_All;
+		}
+		else if (!strcmp(cmd, "stats")) {
+			const char* why;
+			if (!tw.m_Frames.startCsv(arg, &why)) {
+				fprintf(stderr, "%s:%d: %s: %s\n", script, line, arg, why);
+				result = 1;
+			}
+		}
+		else if (!strcmp(cmd, "edit")) {
+			// the whole file is one edit, like the Edits button
+			TrackEdit edits;
+			const char* why;
+			int at = 0;
+			if (!edits.read(arg, &why, &at) ||
+				 !edits.apply(tw.m_Track, tw.splineBrowser->value(), &tw.m_History, &why, &at)) {
+				fprintf(stderr, "%s:%d: %s:%d: %s\n", script, line, arg, at, why);
+				result = 1;
+			}
+			changed = Dirty_Track;
+		}
+		else if (!strcmp(cmd, "seed")) {
+			tv->seed = (unsigned) strtoul(arg, 0, 10);
+			changed = Dirty_Scenery;
+		}
+		else if (!strcmp(cmd, "frames")) {
+			const int n = atoi(arg);
+			for (int i = 0; i < n; ++i, ++frame) {
+				std::chrono::high_resolution_clock::time_point t0 = std::chrono::high_resolution_clock::now();
+				tw.advanceTrain();
+				std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+
+				if (!renderFrame(tv, log, frame, std::chrono::duration<double, std::milli>(t1 - t0).count(),
+									  outDir, buffer, width, height)) {
+					result = 1;
+					break;
+				}
+			}
+		}
+		else if (!strcmp(cmd, "drag")) {
+			// the mouse goes around a circle in the middle of the window
+			// with the point, a few drag events per frame, then lets go -
+			// all through the same calls as the real events
+			const int point = atoi(arg);
+			const int n = words.size() > 2 ? atoi(words[2]) : 120;
+			const int events = words.size() > 3 ? std::max(1, atoi(words[3])) : 4;
+			if (point < 0 || point >= (int) tw.m_Track.points.size()) {
+				fprintf(stderr, "%s:%d: no point %s to drag\n", script, line, arg);
+				result = 1;
+			}
+			else {
+				tv->select(point);
+				tw.m_Latency.clear();
+				for (int i = 0; i <= n && !result; ++i, ++frame) {
+					for (int e = 0; e < events && i < n; ++e) {
+						const double a = 2 * M_PI * (i * events + e) / (n * events);
+						tv->dragTo(width / 2 + (int) (width / 4 * cos(a)),
+									  height / 2 + (int) (height / 4 * sin(a)), false);
+					}
+					// the last frame is the one after letting go
+					if (i == n) {
+						tw.m_Latency.stamp();
+						tv->endDrag();
+					}
+					if (!renderFrame(tv, log, frame, 0, outDir, buffer, width, height))
+						result = 1;
+				}
+				printf("drag of point %d, %d frames, %d events: input to frame p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+						 point, n, (int) tw.m_Latency.count(), tw.m_Latency.percentile(50),
+						 tw.m_Latency.percentile(95), tw.m_Latency.percentile(99), tw.m_Latency.worst());
+			}
+		}
+		else {
+			fprintf(stderr, "%s:%d: unknown command %s\n", script, line, cmd);
+			result = 1;
+		}
+
+		if (changed != Dirty_None)
+			tw.damageMe(changed);
+	}
+
+	printf("%d frames rendered into %s\n", frame, outDir);
+
+	OSMesaDestroyContext(ctx);
+	fclose(log);
+	fclose(fp);
+	return result;
+}
+
+#else
+
+//****************************************************************************
+//
+// * built without OSMesa - nothing we can render into
+//============================================================================
+int runHeadless(const char*, const char*)
+//============================================================================
+{
+	fprintf(stderr, "This build has no offscreen renderer (configure with -DHEADLESS=ON)\n");
+	return 1;
+}
+
+#endif
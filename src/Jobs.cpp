@@ -0,0 +1,282 @@
+/************************************************************************
+     File:        Jobs.cpp
+
+     Comment:     A small work-stealing thread pool
+
+						See Jobs.H
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <algorithm>
+
+#include "Jobs.H"
+
+// the queue of the worker running on this thread, -1 for everybody else
+static thread_local int Worker_Queue = -1;
+static thread_local const void* Worker_Pool = 0;
+
+// how the shared pool is made, and is it there yet
+static int Shared_Workers = -1;
+static std::atomic<bool> Shared_Started(false);
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+JobPool::
+JobPool(const int count)
+	: queued(0), next(0), running(true)
+//============================================================================
+{
+	int n = count;
+	if (n < 0)
+		n = std::max(0, (int) std::thread::hardware_concurrency() - 1);
+
+	for (int q = 0; q < n; ++q)
+		queues.push_back(new Queue);
+	for (int q = 0; q < n; ++q)
+		workers.push_back(std::thread(&JobPool::work, this, q));
+}
+
+//****************************************************************************
+//
+// * the workers finish what is queued first
+//============================================================================
+JobPool::
+~JobPool()
+//============================================================================
+{
+	{
+		std::lock_guard<std::mutex> hold(sleepLock);
+		running = false;
+	}
+	wake.notify_all();
+	for (size_t q = 0; q < workers.size(); ++q)
+		workers[q].join();
+	for (size_t q = 0; q < queues.size(); ++q)
+		delete queues[q];
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+JobPool& JobPool::
+shared()
+//============================================================================
+{
+	static JobPool pool(Shared_Workers);
+	Shared_Started = true;
+	return pool;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+bool JobPool::
+configure(const int workers)
+//============================================================================
+{
+	if (Shared_Started)
+		return false;
+	Shared_Workers = workers;
+	return true;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+int JobPool::
+threads() const
+//============================================================================
+{
+	return (int) workers.size() + 1;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void JobPool::
+push(const int q, const Job& job)
+//============================================================================
+{
+	{
+		std::lock_guard<std::mutex> hold(queues[q]->lock);
+		queues[q]->jobs.push_back(job);
+	}
+	{
+		// (under the lock, so a worker going to sleep can't miss it)
+		std::lock_guard<std::mutex> hold(sleepLock);
+		++queued;
+	}
+	wake.notify_one();
+}
+
+//****************************************************************************
+//
+// * q is -1 for a thread that isn't one of the workers
+//============================================================================
+bool JobPool::
+take(const int q, Job& job, const JobGroup* only)
+//============================================================================
+{
+	if (queued.load() == 0)
+		return false;
+
+	if (only)
+	{
+		for (size_t k = 0; k < queues.size(); ++k)
+		{
+			Queue& other = *queues[k];
+			std::lock_guard<std::mutex> hold(other.lock);
+			for (std::deque<Job>::iterator i = other.jobs.begin(); i != other.jobs.end(); ++i)
+				if (i->group == only) {
+					job = *i;
+					other.jobs.erase(i);
+					--queued;
+					return true;
+				}
+		}
+		return false;
+	}
+
+	if (q >= 0)
+	{
+		Queue& own = *queues[q];
+		std::lock_guard<std::mutex> hold(own.lock);
+		if (!own.jobs.empty()) {
+			job = own.jobs.back();
+			own.jobs.pop_back();
+			--queued;
+			return true;
+		}
+	}
+
+	const int n = (int) queues.size();
+	const int start = q >= 0 ? q + 1 : (int) (next.load() % (unsigned) std::max(n, 1));
+	for (int k = 0; k < n; ++k)
+	{
+		Queue& other = *queues[(start + k) % n];
+		std::lock_guard<std::mutex> hold(other.lock);
+		if (!other.jobs.empty()) {
+			job = other.jobs.front();
+			other.jobs.pop_front();
+			--queued;
+			return true;
+		}
+	}
+	return false;
+}
+
+//****************************************************************************
+//
+// * a worker thread
+//============================================================================
+void JobPool::
+work(const int q)
+//============================================================================
+{
+	Worker_Queue = q;
+	Worker_Pool = this;
+
+	Job job;
+	for (;;)
+	{
+		if (take(q, job)) {
+			job.run();
+			--job.group->pending;
+			continue;
+		}
+
+		std::unique_lock<std::mutex> hold(sleepLock);
+		if (!running && queued.load() == 0)
+			return;
+		if (queued.load() == 0)
+			wake.wait(hold);
+	}
+}
+
+//****************************************************************************
+//
+// * a job from one of our workers goes on its own queue, it is the most
+//   likely to get to it, the others are spread over the queues
+//============================================================================
+void JobPool::
+submit(JobGroup& group, const std::function<void()>& job)
+//============================================================================
+{
+	++group.pending;
+	if (workers.empty()) {
+		job();
+		--group.pending;
+		return;
+	}
+
+	Job j = { job, &group };
+	const int q = Worker_Pool == this ? Worker_Queue : (int) (next++ % (unsigned) queues.size());
+	push(q, j);
+}
+
+//****************************************************************************
+//
+// * a worker runs whatever is queued (not just the jobs of the group)
+//   until the group is done - that is what keeps nested waits from
+//   blocking. any other thread only helps with the jobs of the group,
+//   a job it doesn't wait for could take as long as it likes
+//============================================================================
+void JobPool::
+wait(JobGroup& group)
+//============================================================================
+{
+	const int q = Worker_Pool == this ? Worker_Queue : -1;
+
+	Job job;
+	while (group.pending.load() > 0)
+	{
+		if (take(q, job, q < 0 ? &group : 0)) {
+			job.run();
+			--job.group->pending;
+		}
+		else
+			std::this_thread::yield();
+	}
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void JobPool::
+parallelFor(const int count, const int grain,
+				const std::function<void(int begin, int end)>& body)
+//============================================================================
+{
+	if (count <= 0)
+		return;
+
+	const int most = (count + std::max(grain, 1) - 1) / std::max(grain, 1);
+	const int pieces = std::min(most, threads() * Jobs_Pieces_Per_Thread);
+	if (pieces <= 1 || workers.empty()) {
+		body(0, count);
+		return;
+	}
+
+	// the pieces go round the queues, each is a job of its own
+	JobGroup group;
+	group.pending += pieces;
+	const int n = (int) queues.size();
+	const int first = Worker_Pool == this ? Worker_Queue : (int) (next++ % (unsigned) n);
+	for (int p = 0; p < pieces; ++p)
+	{
+		const int begin = (int) ((long long) count * p / pieces);
+		const int end = (int) ((long long) count * (p + 1) / pieces);
+		Job j = { [&body, begin, end]() { body(begin, end); }, &group };
+		push((first + p) % n, j);
+	}
+	wait(group);
+}
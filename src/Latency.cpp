@@ -0,0 +1,114 @@
+/************************************************************************
+     File:        Latency.cpp
+
+     Comment:     How long input waits for the frame that shows it
+
+						See Latency.H
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <algorithm>
+
+#include "Latency.H"
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+LatencyLog::
+LatencyLog()
+	: next(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void LatencyLog::
+stamp()
+//============================================================================
+{
+	// (nothing is drawn at all, don't pile them up)
+	if (pending.size() < (size_t) Latency_Samples)
+		pending.push_back(Clock::now());
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void LatencyLog::
+frameDone()
+//============================================================================
+{
+	if (pending.empty())
+		return;
+
+	const Clock::time_point done = Clock::now();
+	for (size_t k = 0; k < pending.size(); ++k)
+	{
+		const float ms = (float) std::chrono::duration<double, std::milli>(done - pending[k]).count();
+		if (waits.size() < (size_t) Latency_Samples)
+			waits.push_back(ms);
+		else
+			waits[next] = ms;
+		next = (next + 1) % Latency_Samples;
+	}
+	pending.clear();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void LatencyLog::
+clear()
+//============================================================================
+{
+	pending.clear();
+	waits.clear();
+	next = 0;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+size_t LatencyLog::
+count() const
+//============================================================================
+{
+	return waits.size();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+double LatencyLog::
+percentile(const double p) const
+//============================================================================
+{
+	if (waits.empty())
+		return 0;
+
+	sorted = waits;
+	const size_t k = std::min(sorted.size() - 1, (size_t) (p / 100 * sorted.size()));
+	std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+	return sorted[k];
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+double LatencyLog::
+worst() const
+//============================================================================
+{
+	return waits.empty() ? 0 : *std::max_element(waits.begin(), waits.end());
+}
@@ -0,0 +1,358 @@
+/************************************************************************
+     File:        Mesh.cpp
+
+     Comment:     Pre-built geometry for the things in the world
+
+						Rather than issuing glBegin/glEnd for every box
+						each time we draw, the tessellation code appends
+						its quads into a Mesh once. The mesh is then drawn
+						from vertex arrays as many times as we like - once
+						for the objects and once for the shadows, which
+						just redraw the same arrays under the squishing
+						matrix (without the colors).
+
+						See Mesh.H for the MeshBuffers.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <windows.h>
+#include <GL/gl.h>
+
+#include "Mesh.H"
+
+DrawCounters Mesh::drawn = { 0, 0 };
+
+//****************************************************************************
+//
+// * corner of a box cross section, p + a * u + b * v
+//============================================================================
+static inline Pnt3f corner(const Pnt3f& p, const Pnt3f& u, const Pnt3f& v,
+									const float a, const float b)
+//============================================================================
+{
+	return Pnt3f(p.x + a * u.x + b * v.x,
+					 p.y + a * u.y + b * v.y,
+					 p.z + a * u.z + b * v.z);
+}
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+Mesh::
+Mesh()
+//============================================================================
+{
+	rgb[0] = rgb[1] = rgb[2] = 255;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void Mesh::
+clear()
+//============================================================================
+{
+	vertices.clear();
+	normals.clear();
+	colors.clear();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void Mesh::
+color(unsigned char r, unsigned char g, unsigned char b)
+//============================================================================
+{
+	rgb[0] = r;
+	rgb[1] = g;
+	rgb[2] = b;
+}
+
+//****************************************************************************
+//
+// * the quads of other after ours, in their own colors
+//============================================================================
+void Mesh::
+append(const Mesh& other)
+//============================================================================
+{
+	vertices.insert(vertices.end(), other.vertices.begin(), other.vertices.end());
+	normals.insert(normals.end(), other.normals.begin(), other.normals.end());
+	colors.insert(colors.end(), other.colors.begin(), other.colors.end());
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+size_t Mesh::
+size() const
+//============================================================================
+{
+	return vertices.size() / 3;
+}
+
+//****************************************************************************
+//
+// * one flat shaded quad
+//============================================================================
+void Mesh::
+quad(const Pnt3f& n, const Pnt3f& a, const Pnt3f& b, const Pnt3f& c, const Pnt3f& d)
+//============================================================================
+{
+	const Pnt3f* v[4] = { &a, &b, &c, &d };
+	for (int i = 0; i < 4; ++i) {
+		vertices.push_back(v[i]->x);
+		vertices.push_back(v[i]->y);
+		vertices.push_back(v[i]->z);
+		normals.push_back(n.x);
+		normals.push_back(n.y);
+		normals.push_back(n.z);
+		colors.push_back(rgb[0]);
+		colors.push_back(rgb[1]);
+		colors.push_back(rgb[2]);
+	}
+}
+
+//****************************************************************************
+//
+// * x-> u, y -> v
+//============================================================================
+void Mesh::
+addBox(const Pnt3f& np, const Pnt3f& nu, const Pnt3f& nv,
+		 const Pnt3f& fp, const Pnt3f& fu, const Pnt3f& fv,
+		 float hw, float hh, bool dnfs)
+//============================================================================
+{
+	quad(Pnt3f(nu.y * (fp.z - np.z + hh * (fv.z - nv.z)) - nu.z * (fp.y - np.y + hh * (fv.y - nv.y)),
+				  nu.z * (fp.x - np.x + hh * (fv.x - nv.x)) - nu.x * (fp.z - np.z + hh * (fv.z - nv.z)),
+				  nu.x * (fp.y - np.y + hh * (fv.y - nv.y)) - nu.y * (fp.x - np.x + hh * (fv.x - nv.x))),
+		  corner(np, nu, nv, -hw,  hh), corner(fp, fu, fv, -hw,  hh),
+		  corner(fp, fu, fv,  hw,  hh), corner(np, nu, nv,  hw,  hh));
+
+	quad(Pnt3f(nu.z * (fp.y - np.y - hh * (fv.y - nv.y) - nu.y * (fp.z - np.z - hh * (fv.z - nv.z))),
+				  nu.x * (fp.z - np.z - hh * (fv.z - nv.z) - nu.z * (fp.x - np.x - hh * (fv.x - nv.x))),
+				  nu.y * (fp.x - np.x - hh * (fv.x - nv.x) - nu.x * (fp.y - np.y - hh * (fv.y - nv.y)))),
+		  corner(np, nu, nv, -hw, -hh), corner(np, nu, nv,  hw, -hh),
+		  corner(fp, fu, fv,  hw, -hh), corner(fp, fu, fv, -hw, -hh));
+
+	quad(Pnt3f((fp.y - np.y - hw * (fv.y - nu.y)) * nv.z - (fp.z - np.z - hw * (fv.z - nu.z)) * nv.y,
+				  (fp.z - np.z - hw * (fv.z - nu.z)) * nv.x - (fp.x - np.x - hw * (fv.x - nu.x)) * nv.z,
+				  (fp.x - np.x - hw * (fv.x - nu.x)) * nv.y - (fp.y - np.y - hw * (fv.y - nu.y)) * nv.x),
+		  corner(np, nu, nv, -hw, -hh), corner(fp, fu, fv, -hw, -hh),
+		  corner(fp, fu, fv, -hw,  hh), corner(np, nu, nv, -hw,  hh));
+
+	quad(Pnt3f((fp.y - np.y + hw * (fv.y - nu.y)) * -nv.z - (fp.z - np.z + hw * (fv.z - nu.z)) * -nv.y,
+				  (fp.z - np.z + hw * (fv.z - nu.z)) * -nv.x - (fp.x - np.x + hw * (fv.x - nu.x)) * -nv.z,
+				  (fp.x - np.x + hw * (fv.x - nu.x)) * -nv.y - (fp.y - np.y + hw * (fv.y - nu.y)) * -nv.x),
+		  corner(np, nu, nv,  hw,  hh), corner(fp, fu, fv,  hw,  hh),
+		  corner(fp, fu, fv,  hw, -hh), corner(np, nu, nv,  hw, -hh));
+
+	if (dnfs)
+	{
+		quad(Pnt3f(np.x - fp.x, np.y - fp.y, np.z - fp.z),
+			  corner(np, nu, nv, -hw, -hh), corner(np, nu, nv, -hw,  hh),
+			  corner(np, nu, nv,  hw,  hh), corner(np, nu, nv,  hw, -hh));
+
+		quad(Pnt3f(fp.x - np.x, fp.y - np.y, fp.z - np.z),
+			  corner(fp, fu, fv, -hw, -hh), corner(fp, fu, fv,  hw, -hh),
+			  corner(fp, fu, fv,  hw,  hh), corner(fp, fu, fv, -hw,  hh));
+	}
+}
+
+//****************************************************************************
+//
+// * point GL at the arrays
+//============================================================================
+void Mesh::
+bind(bool useColors) const
+//============================================================================
+{
+	glEnable(GL_NORMALIZE);
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, &vertices[0]);
+	glNormalPointer(GL_FLOAT, 0, &normals[0]);
+	if (useColors) {
+		glEnableClientState(GL_COLOR_ARRAY);
+		glColorPointer(3, GL_UNSIGNED_BYTE, 0, &colors[0]);
+	}
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void Mesh::
+unbind(bool useColors) const
+//============================================================================
+{
+	if (useColors)
+		glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+//****************************************************************************
+//
+// * draw straight out of the arrays - no per vertex calls
+//============================================================================
+void Mesh::
+draw(bool useColors) const
+//============================================================================
+{
+	if (vertices.empty())
+		return;
+
+	bind(useColors);
+	glDrawArrays(GL_QUADS, 0, (GLsizei) size());
+	unbind(useColors);
+
+	++drawn.calls;
+	drawn.vertices += (long) size();
+}
+
+//****************************************************************************
+//
+// * the fixed pipeline has no instancing, so this is the next best thing:
+//   the arrays are bound once and only the matrix changes per instance
+//============================================================================
+void Mesh::
+drawInstances(const std::vector<float>& frames, bool useColors) const
+//============================================================================
+{
+	if (vertices.empty() || frames.empty())
+		return;
+
+	bind(useColors);
+	glMatrixMode(GL_MODELVIEW);
+	for (size_t i = 0; i + 16 <= frames.size(); i += 16) {
+		glPushMatrix();
+		glMultMatrixf(&frames[i]);
+		glDrawArrays(GL_QUADS, 0, (GLsizei) size());
+		glPopMatrix();
+	}
+	unbind(useColors);
+
+	drawn.calls += (long) (frames.size() / 16);
+	drawn.vertices += (long) (frames.size() / 16 * size());
+}
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+MeshBuffers::
+MeshBuffers()
+	: current(0), state(Idle)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+const MeshPieces& MeshBuffers::
+front() const
+//============================================================================
+{
+	return meshes[current];
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+MeshPieces& MeshBuffers::
+back()
+//============================================================================
+{
+	return meshes[1 - current];
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+bool MeshBuffers::
+start()
+//============================================================================
+{
+	int idle = Idle;
+	return state.compare_exchange_strong(idle, Building);
+}
+
+//****************************************************************************
+//
+// * (the store publishes the mesh to the thread that swaps it in)
+//============================================================================
+void MeshBuffers::
+finish()
+//============================================================================
+{
+	state.store(Built);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+bool MeshBuffers::
+swap()
+//============================================================================
+{
+	if (state.load() != Built)
+		return false;
+	current = 1 - current;
+	state.store(Idle);
+	return true;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+bool MeshBuffers::
+busy() const
+//============================================================================
+{
+	return state.load() != Idle;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void MeshBuffers::
+draw(const bool useColors) const
+//============================================================================
+{
+	const MeshPieces& pieces = meshes[current];
+	for (size_t p = 0; p < pieces.size(); ++p)
+		if (pieces[p])
+			pieces[p]->draw(useColors);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+size_t MeshBuffers::
+size() const
+//============================================================================
+{
+	const MeshPieces& pieces = meshes[current];
+	size_t n = 0;
+	for (size_t p = 0; p < pieces.size(); ++p)
+		if (pieces[p])
+			n += pieces[p]->size();
+	return n;
+}
@@ -0,0 +1,161 @@
+/************************************************************************
+     File:        Picker.cpp
+
+     Comment:     Which control points are under the mouse?
+
+						See Picker.H
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <algorithm>
+#include <math.h>
+
+#include "Jobs.H"
+#include "Picker.H"
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+PointPicker::
+PointPicker()
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void PointPicker::
+project(const std::vector<ControlPoint>& points,
+		  const double modelview[16], const double projection[16],
+		  const int viewport[4])
+//============================================================================
+{
+	// everything in one matrix, clip = m * point
+	double m[16];
+	for (int c = 0; c < 4; ++c)
+		for (int r = 0; r < 4; ++r) {
+			double sum = 0;
+			for (int k = 0; k < 4; ++k)
+				sum += projection[k * 4 + r] * modelview[c * 4 + k];
+			m[c * 4 + r] = sum;
+		}
+
+	// a length of one at w = 1 in pixels (the projection scales y by
+	// projection[5], the viewport maps -1..1 to its height)
+	const double scale = fabs(projection[5]) * viewport[3] * 0.5;
+
+	projected.resize(points.size());
+	JobPool::shared().parallelFor((int) points.size(), Pick_Grain, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i) {
+			const Pnt3f& p = points[i].pos;
+			const double x = m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12];
+			const double y = m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13];
+			const double z = m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14];
+			const double w = m[3] * p.x + m[7] * p.y + m[11] * p.z + m[15];
+
+			PickPoint& q = projected[i];
+			q.visible = w > 0 && z >= -w && z <= w;
+			if (!q.visible)
+				continue;
+			q.x = (float) (viewport[0] + viewport[2] * (x / w + 1) * 0.5);
+			q.y = (float) (viewport[1] + viewport[3] * (y / w + 1) * 0.5);
+			q.depth = z / w;
+			q.radius = std::max(Pick_Slop, (float) (Pick_Size * scale / w));
+		}
+	});
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+int PointPicker::
+pick(const float x, const float y) const
+//============================================================================
+{
+	int nearest = -1;
+	for (size_t i = 0; i < projected.size(); ++i) {
+		const PickPoint& q = projected[i];
+		if (!q.visible || fabs(q.x - x) > q.radius || fabs(q.y - y) > q.radius)
+			continue;
+		if (nearest < 0 || q.depth < projected[nearest].depth)
+			nearest = (int) i;
+	}
+	return nearest;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void PointPicker::
+inBox(const float x0, const float y0, const float x1, const float y1,
+		std::vector<int>& found) const
+//============================================================================
+{
+	const float left = std::min(x0, x1), right = std::max(x0, x1);
+	const float bottom = std::min(y0, y1), top = std::max(y0, y1);
+
+	found.clear();
+	for (size_t i = 0; i < projected.size(); ++i) {
+		const PickPoint& q = projected[i];
+		if (q.visible && q.x >= left && q.x <= right && q.y >= bottom && q.y <= top)
+			found.push_back((int) i);
+	}
+}
+
+//****************************************************************************
+//
+// * even-odd rule: a point is in if a ray from it crosses the edges an
+//   odd number of times
+//============================================================================
+void PointPicker::
+inLasso(const std::vector<float>& polygon, std::vector<int>& found) const
+//============================================================================
+{
+	found.clear();
+	const int n = (int) polygon.size() / 2;
+	if (n < 3)
+		return;
+
+	// most of the points aren't even near it
+	float left = polygon[0], right = polygon[0], bottom = polygon[1], top = polygon[1];
+	for (int k = 1; k < n; ++k) {
+		left = std::min(left, polygon[2 * k]);
+		right = std::max(right, polygon[2 * k]);
+		bottom = std::min(bottom, polygon[2 * k + 1]);
+		top = std::max(top, polygon[2 * k + 1]);
+	}
+
+	for (size_t i = 0; i < projected.size(); ++i) {
+		const PickPoint& q = projected[i];
+		if (!q.visible || q.x < left || q.x > right || q.y < bottom || q.y > top)
+			continue;
+
+		bool in = false;
+		for (int k = 0, j = n - 1; k < n; j = k++) {
+			const float xk = polygon[2 * k], yk = polygon[2 * k + 1];
+			const float xj = polygon[2 * j], yj = polygon[2 * j + 1];
+			if ((yk > q.y) != (yj > q.y) && q.x < (xj - xk) * (q.y - yk) / (yj - yk) + xk)
+				in = !in;
+		}
+		if (in)
+			found.push_back((int) i);
+	}
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+int PointPicker::
+size() const
+//============================================================================
+{
+	return (int) projected.size();
+}
@@ -0,0 +1,317 @@
+/************************************************************************
+     File:        RideAnalysis.cpp
+
+     Comment:     Ride statistics for a track
+
+						See RideAnalysis.H
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <float.h>
+#include <math.h>
+#include <chrono>
+#include <thread>
+
+#include "RideAnalysis.H"
+#include "Jobs.H"
+#include "RideLog.H"
+#include "Spline.H"
+#include "Telemetry.H"
+
+//****************************************************************************
+//
+// * small vector helpers, Pnt3f only has the basics
+//============================================================================
+static inline Pnt3f sub(const Pnt3f& a, const Pnt3f& b)
+{
+	return Pnt3f(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+static inline float dot(const Pnt3f& a, const Pnt3f& b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static inline float length(const Pnt3f& a)
+{
+	return sqrt(dot(a, a));
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+RideStats::
+RideStats()
+	: ok(false), points(0), length(0), maxHeight(0), maxSpeed(0),
+	  maxVerticalG(0), minVerticalG(0), maxLateralG(0), lapTime(0),
+	  ticks(0), lapCompleted(false)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+RunStats::
+RunStats()
+	: ticks(0), wallSeconds(0), spacingEvents(0), collisions(0), minGap(FLT_MAX)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * the same defaults as the window
+//============================================================================
+RideOptions::
+RideOptions()
+	: spline(Spline_Cardinal), maxTime(600)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * measure the track, then run the train around once
+//============================================================================
+void
+analyzeRide(const CTrack& track, const RideOptions& options, RideStats& stats)
+//============================================================================
+{
+	const int n = (int) track.points.size();
+	const float dt = 1.0f / Tick_Rate;
+
+	stats = RideStats();
+	stats.ok = true;
+	stats.points = track.points.size();
+
+	// the shape of the track comes from the arc length table
+	TrainSim sim(options.settings);
+	sim.table.update(track, options.spline);
+	stats.length = (float) sim.table.length();
+	for (size_t i = 0; i < sim.table.heights.size(); ++i)
+	{
+		if (i == 0 || sim.table.heights[i] > stats.maxHeight)
+			stats.maxHeight = sim.table.heights[i];
+	}
+
+	// now ride it
+	Pnt3f pos, dir, up;
+	sim.head[0] = 0;
+
+	const long maxTicks = (long) (options.maxTime * Tick_Rate);
+	double travelled = 0;
+	double u = sim.head[0];
+	Pnt3f last_pos, last_vel;
+	getCurvesPoint(track.points, options.spline, u, &last_pos, NULL, NULL);
+
+	while (stats.ticks < maxTicks)
+	{
+		sim.advance(track, options.spline);
+		stats.ticks++;
+
+		// how far did we go in parameter space (it wraps around) - forward
+		// only as far as it got, rocking back and forth in a valley isn't
+		// going around
+		double du = sim.head[0] - u;
+		if (du > n / 2.0) du -= n;
+		if (du < -n / 2.0) du += n;
+		travelled += du;
+		u = sim.head[0];
+
+		getCurvesPoint(track.points, options.spline, u, &pos, &dir, &up);
+		const Pnt3f vel = sub(pos, last_pos) * (1.0f / dt);
+		const float speed = length(vel);
+		if (speed > stats.maxSpeed)
+			stats.maxSpeed = speed;
+
+		if (stats.ticks > 1)
+		{
+			// what the riders feel is the acceleration minus gravity
+			Pnt3f felt = sub(vel, last_vel) * (1.0f / dt);
+			felt.y += Gravity;
+
+			Pnt3f cross = dir * up;
+			cross.normalize();
+			Pnt3f on = cross * dir;
+			on.normalize();
+
+			const float vertical = dot(felt, on) / Gravity;
+			const float lateral = fabs(dot(felt, cross)) / Gravity;
+			if (stats.ticks == 2 || vertical > stats.maxVerticalG)
+				stats.maxVerticalG = vertical;
+			if (stats.ticks == 2 || vertical < stats.minVerticalG)
+				stats.minVerticalG = vertical;
+			if (lateral > stats.maxLateralG)
+				stats.maxLateralG = lateral;
+		}
+
+		last_pos = pos;
+		last_vel = vel;
+
+		if (travelled >= n)
+		{
+			stats.lapCompleted = true;
+			break;
+		}
+	}
+	stats.lapTime = stats.ticks * dt;
+}
+
+//****************************************************************************
+//
+// * the speed of a train is how far its distance moved in the tick, which
+//   is the same with physics and without
+//============================================================================
+void
+runRide(const CTrack& track, const int spline, TrainSim& sim, const long ticks,
+		  const double rate, RunStats& stats, RideRecorder* recorder, Telemetry* telemetry)
+//============================================================================
+{
+	const int m = sim.trains();
+	if ((int) stats.last.size() != m)
+	{
+		sim.placeCars(track, spline);
+		stats.laps.assign(m, 0);
+		stats.minSpeed.assign(m, FLT_MAX);
+		stats.maxSpeed.assign(m, 0);
+		stats.brakedTicks.assign(m, 0);
+		stats.last = sim.distance;
+	}
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (long k = 0; k < ticks; ++k)
+	{
+		sim.advance(track, spline);
+		if (recorder)
+			recorder->tick(sim, track, spline, 1);
+		if (telemetry)
+			telemetry->tick(sim, track, spline);
+
+		const double total = sim.table.length();
+		for (int t = 0; t < m; ++t)
+		{
+			double d = sim.distance[t] - stats.last[t];
+			if (d > total / 2) d -= total;
+			if (d < -total / 2) d += total;
+			stats.last[t] = sim.distance[t];
+			if (total > 0)
+				stats.laps[t] += d / total;
+
+			if (sim.braking && sim.braked[t]) {
+				stats.brakedTicks[t]++;
+				continue;
+			}
+			const float v = (float) fabs(d) * Tick_Rate;
+			if (v < stats.minSpeed[t])
+				stats.minSpeed[t] = v;
+			if (v > stats.maxSpeed[t])
+				stats.maxSpeed[t] = v;
+		}
+
+		for (size_t i = 0; i < sim.events.size(); ++i)
+		{
+			stats.spacingEvents++;
+			if (sim.events[i].collision)
+				stats.collisions++;
+			if (sim.events[i].gap < stats.minGap)
+				stats.minGap = sim.events[i].gap;
+		}
+		stats.ticks++;
+
+		// running ahead of the clock, wait for it
+		if (rate > 0)
+			std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<double>((k + 1) / (rate * Tick_Rate))));
+	}
+	stats.wallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void
+analyzeRide(const char* filename, const RideOptions& options, RideStats& stats)
+//============================================================================
+{
+	CTrack track;
+	if (!track.readPoints(filename) || track.points.size() < 4) {
+		stats = RideStats();
+		return;
+	}
+	analyzeRide(track, options, stats);
+}
+
+//****************************************************************************
+//
+// * the files are spread over the shared pool - the table and the curve
+//   of every file go on it too, a pool of our own would only add threads
+//============================================================================
+void
+analyzeRides(const std::vector<std::string>& files, const RideOptions& options,
+				 std::vector<RideStats>& stats, unsigned threads)
+//============================================================================
+{
+	stats.assign(files.size(), RideStats());
+
+	if (threads > 0)
+		JobPool::configure((int) threads - 1);
+	JobPool::shared().parallelFor((int) files.size(), 1, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i)
+			analyzeRide(files[i].c_str(), options, stats[i]);
+	});
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void
+writeRideCSVHeader(FILE* fp)
+//============================================================================
+{
+	fprintf(fp, "file,ok,points,length,max_height,max_speed,max_vertical_g,"
+					"min_vertical_g,max_lateral_g,lap_time,lap_completed\n");
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void
+writeRideCSV(FILE* fp, const std::string& file, const RideStats& s)
+//============================================================================
+{
+	fprintf(fp, "\"%s\",%d,%u,%g,%g,%g,%g,%g,%g,%g,%d\n",
+			  file.c_str(), s.ok ? 1 : 0, (unsigned) s.points, s.length, s.maxHeight,
+			  s.maxSpeed, s.maxVerticalG, s.minVerticalG, s.maxLateralG,
+			  s.lapTime, s.lapCompleted ? 1 : 0);
+}
+
+//****************************************************************************
+//
+// * one JSON object per line
+//============================================================================
+void
+writeRideJSON(FILE* fp, const std::string& file, const RideStats& s)
+//============================================================================
+{
+	std::string name;
+	for (size_t i = 0; i < file.size(); ++i) {
+		if (file[i] == '"' || file[i] == '\\')
+			name += '\\';
+		name += file[i];
+	}
+	fprintf(fp, "{\"file\": \"%s\", \"ok\": %s, \"points\": %u, \"length\": %g, "
+					"\"max_height\": %g, \"max_speed\": %g, \"max_vertical_g\": %g, "
+					"\"min_vertical_g\": %g, \"max_lateral_g\": %g, \"lap_time\": %g, "
+					"\"lap_completed\": %s}\n",
+			  name.c_str(), s.ok ? "true" : "false", (unsigned) s.points, s.length, s.maxHeight,
+			  s.maxSpeed, s.maxVerticalG, s.minVerticalG, s.maxLateralG,
+			  s.lapTime, s.lapCompleted ? "true" : "false");
+}
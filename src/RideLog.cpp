@@ -0,0 +1,708 @@
+/************************************************************************
+     File:        RideLog.cpp
+
+     Comment:     Recording a ride and playing it back
+
+						See RideLog.H
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#include "RideLog.H"
+#include "Spline.H"
+
+static const char Ride_Log_Magic[8] = { 'R', 'I', 'D', 'E', 'L', 'O', 'G', '1' };
+static const unsigned Ride_Log_Version = 1;
+
+// chunk types
+enum {
+	Chunk_Track = 1,
+	Chunk_Tick = 2,
+	Chunk_Keyframe = 3
+};
+
+// the settings of the sim, in one byte
+enum {
+	Flag_Physics = 1,
+	Flag_ArcLength = 2,
+	Flag_Braking = 4
+};
+
+// why a keyframe was written
+enum {
+	Key_Interval = 0,
+	Key_Edited = 1
+};
+
+// sizes of the parts of the chunks
+static const size_t Chunk_Header = 2 * sizeof(unsigned);
+static const size_t Tick_Size = 2 * sizeof(unsigned) + 4 + sizeof(float);
+static const size_t Tick_Train = sizeof(double) + sizeof(float);
+static const size_t Key_Size = sizeof(unsigned) + 4 + 3 * sizeof(float) + sizeof(unsigned long long) + sizeof(unsigned);
+static const size_t Key_Train = 2 * sizeof(float) + sizeof(int) + 2 * sizeof(double) + 2 * sizeof(float);
+
+//****************************************************************************
+//
+// *
+//============================================================================
+static unsigned char simFlags(const TrainSim& sim)
+//============================================================================
+{
+	return (sim.physics ? Flag_Physics : 0) | (sim.arcLength ? Flag_ArcLength : 0) |
+			 (sim.braking ? Flag_Braking : 0);
+}
+
+//****************************************************************************
+//
+// * is size exactly a fixed part and then n parts of each bytes?
+//============================================================================
+static bool sized(const size_t size, const size_t fixed, const size_t each, const size_t n)
+//============================================================================
+{
+	return size >= fixed && (size - fixed) % each == 0 && (size - fixed) / each == n;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+static void setSimFlags(TrainSim& sim, const unsigned char flags)
+//============================================================================
+{
+	sim.physics = (flags & Flag_Physics) != 0;
+	sim.arcLength = (flags & Flag_ArcLength) != 0;
+	sim.braking = (flags & Flag_Braking) != 0;
+}
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+RideRecorder::
+RideRecorder()
+	: ticks(0), keyframes(0), dropped(0), fp(0), pending(0), published(0), taken(0),
+	  running(false), tickCount(0), sinceKey(0), keyNext(true), trackAt(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+RideRecorder::
+~RideRecorder()
+//============================================================================
+{
+	stop();
+}
+
+//****************************************************************************
+//
+// * everything that may be needed is allocated here, not in tick
+//============================================================================
+bool RideRecorder::
+start(const char* filename, const char** why)
+//============================================================================
+{
+	stop();
+
+	fp = fopen(filename, "wb");
+	if (!fp) {
+		if (why) *why = "Can't open the file for writing";
+		return false;
+	}
+
+	ring.assign(Ride_Log_Buffer, 0);
+	pending = 0;
+	published = 0;
+	taken = 0;
+	ticks = keyframes = dropped = 0;
+	tickCount = 0;
+	sinceKey = 0;
+	keyNext = true;
+	trackAt = 0;
+
+	put(Ride_Log_Magic, sizeof(Ride_Log_Magic));
+	put(Ride_Log_Version);
+	put((unsigned) Tick_Rate);
+	publish();
+
+	running = true;
+	writer = std::thread(&RideRecorder::drain, this);
+	return true;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void RideRecorder::
+stop()
+//============================================================================
+{
+	if (!fp)
+		return;
+
+	running = false;
+	writer.join();
+	fclose(fp);
+	fp = 0;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+bool RideRecorder::
+recording() const
+//============================================================================
+{
+	return fp != 0;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+bool RideRecorder::
+fits(const size_t bytes) const
+//============================================================================
+{
+	return pending + bytes - taken.load(std::memory_order_acquire) <= ring.size();
+}
+
+//****************************************************************************
+//
+// * the positions only ever grow, the place in the ring is the position
+//   modulo its size
+//============================================================================
+void RideRecorder::
+put(const void* data, const size_t bytes)
+//============================================================================
+{
+	const size_t at = pending % ring.size();
+	const size_t first = std::min(bytes, ring.size() - at);
+	memcpy(&ring[at], data, first);
+	memcpy(&ring[0], (const char*) data + first, bytes - first);
+	pending += bytes;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void RideRecorder::
+publish()
+//============================================================================
+{
+	published.store(pending, std::memory_order_release);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void RideRecorder::
+putWaiting(const void* data, const size_t bytes)
+//============================================================================
+{
+	const char* p = (const char*) data;
+	size_t left = bytes;
+	while (left > 0)
+	{
+		const size_t room = ring.size() - (pending - taken.load(std::memory_order_acquire));
+		if (room == 0) {
+			std::this_thread::yield();
+			continue;
+		}
+		const size_t n = std::min(room, left);
+		put(p, n);
+		publish();
+		p += n;
+		left -= n;
+	}
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void RideRecorder::
+writeTrack(const CTrack& track)
+//============================================================================
+{
+	const unsigned count = (unsigned) track.points.size();
+	const unsigned header[3] = { Chunk_Track, (unsigned) (sizeof(unsigned) + count * 6 * sizeof(float)), count };
+
+	trackAt = pending;
+	putWaiting(header, sizeof(header));
+	for (unsigned i = 0; i < count; ++i)
+	{
+		const ControlPoint& c = track.points[i];
+		const float p[6] = { c.pos.x, c.pos.y, c.pos.z, c.orient.x, c.orient.y, c.orient.z };
+		putWaiting(p, sizeof(p));
+	}
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void RideRecorder::
+writeKeyframe(const TrainSim& sim, const int spline, const unsigned char why)
+//============================================================================
+{
+	const int m = sim.trains();
+	put((unsigned) Chunk_Keyframe);
+	put((unsigned) (Key_Size + m * Key_Train));
+
+	put(tickCount);
+	put((unsigned char) spline);
+	put(simFlags(sim));
+	put(why);
+	put((unsigned char) 0);
+	put(sim.headway);
+	put(sim.friction);
+	put(sim.drag);
+	put((unsigned long long) trackAt);
+	put((unsigned) m);
+	for (int t = 0; t < m; ++t)
+	{
+		put(sim.speed[t]);
+		put(sim.weight[t]);
+		put(sim.cars[t]);
+		put(sim.head[t]);
+		put(sim.distance[t]);
+		put(sim.velocity[t]);
+		put(sim.energy[t]);
+	}
+	keyframes++;
+}
+
+//****************************************************************************
+//
+// * the tick and its keyframe go in together or not at all
+//============================================================================
+void RideRecorder::
+tick(const TrainSim& sim, const CTrack& track, const int spline, const float dir)
+//============================================================================
+{
+	if (!recording())
+		return;
+
+	const int m = sim.trains();
+	tickCount++;
+
+	if (sim.rebuilt || trackAt == 0)
+		writeTrack(track);
+
+	const bool edited = keyNext || sim.edited;
+	const bool key = edited || sinceKey + 1 >= Keyframe_Interval;
+
+	const size_t tickBytes = Chunk_Header + Tick_Size + m * Tick_Train;
+	const size_t keyBytes = key ? Chunk_Header + Key_Size + m * Key_Train : 0;
+	if (!fits(tickBytes + keyBytes))
+	{
+		dropped++;
+		keyNext = true;
+		return;
+	}
+
+	put((unsigned) Chunk_Tick);
+	put((unsigned) (tickBytes - Chunk_Header));
+	put(tickCount);
+	put((signed char) (dir < 0 ? -1 : 1));
+	put((unsigned char) spline);
+	put(simFlags(sim));
+	put((unsigned char) 0);
+	put(sim.speed[0]);
+	put((unsigned) m);
+	for (int t = 0; t < m; ++t)
+	{
+		put(sim.distance[t]);
+		put(sim.velocity[t]);
+	}
+
+	if (key)
+		writeKeyframe(sim, spline, edited ? Key_Edited : Key_Interval);
+	publish();
+
+	ticks++;
+	sinceKey = key ? 0 : sinceKey + 1;
+	keyNext = false;
+}
+
+//****************************************************************************
+//
+// * runs until stop, then writes whatever is left
+//============================================================================
+void RideRecorder::
+drain()
+//============================================================================
+{
+	for (;;)
+	{
+		const bool more = running.load();
+		const size_t to = published.load(std::memory_order_acquire);
+		const size_t from = taken.load(std::memory_order_relaxed);
+
+		if (from == to)
+		{
+			if (!more)
+				break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			continue;
+		}
+
+		const size_t at = from % ring.size();
+		const size_t n = std::min(to - from, ring.size() - at);
+		fwrite(&ring[at], 1, n, fp);
+		taken.store(from + n, std::memory_order_release);
+	}
+	fflush(fp);
+}
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+RideReplay::
+RideReplay()
+	: mismatch(0), current(-1), loadedTrack(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+template <class T>
+T RideReplay::
+get(size_t& p) const
+//============================================================================
+{
+	T value;
+	memcpy(&value, &data[p], sizeof(T));
+	p += sizeof(T);
+	return value;
+}
+
+//****************************************************************************
+//
+// * read the whole file and find the ticks and keyframes, a chunk cut off
+//   at the end (the recording didn't stop cleanly) is left out. every
+//   chunk is checked here, once: its size has to be what the counts in
+//   it say and a keyframe has to point at a track before it - seek and
+//   next take them as they are
+//============================================================================
+bool RideReplay::
+open(const char* filename, const char** why)
+//============================================================================
+{
+	close();
+
+	FILE* fp = fopen(filename, "rb");
+	if (!fp) {
+		if (why) *why = "Can't open the file for reading";
+		return false;
+	}
+	fseek(fp, 0, SEEK_END);
+	const long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	data.resize(size > 0 ? size : 0);
+	const bool read = size > 0 && fread(&data[0], 1, data.size(), fp) == data.size();
+	fclose(fp);
+
+	const size_t header = sizeof(Ride_Log_Magic) + 2 * sizeof(unsigned);
+	if (!read || data.size() < header || memcmp(&data[0], Ride_Log_Magic, sizeof(Ride_Log_Magic))) {
+		if (why) *why = "Not a ride log";
+		close();
+		return false;
+	}
+
+	size_t p = sizeof(Ride_Log_Magic);
+	const unsigned version = get<unsigned>(p);
+	const unsigned rate = get<unsigned>(p);
+	if (version != Ride_Log_Version || rate != (unsigned) Tick_Rate) {
+		if (why) *why = "The ride log is from a different version";
+		close();
+		return false;
+	}
+
+	std::vector<size_t> tracks;		// where the track chunks start, in order
+	const char* error = 0;
+	while (!error && p + Chunk_Header <= data.size())
+	{
+		const size_t at = p;
+		const unsigned type = get<unsigned>(p);
+		const size_t size = get<unsigned>(p);
+		if (size > data.size() - p)
+			break;
+
+		size_t q = p;
+		if (type == Chunk_Track)
+		{
+			const size_t count = size >= sizeof(unsigned) ? get<unsigned>(q) : 0;
+			if (count < 4 || count > 65535 || !sized(size, sizeof(unsigned), 6 * sizeof(float), count))
+				error = "A track in the ride log is damaged";
+			else
+				tracks.push_back(at);
+		}
+		else if (type == Chunk_Tick)
+		{
+			if (size < Tick_Size)
+				error = "A tick in the ride log is damaged";
+			else {
+				q += sizeof(unsigned) + 1;
+				const unsigned spline = get<unsigned char>(q);
+				q += 2 + sizeof(float);
+				const size_t m = get<unsigned>(q);
+				if (spline > Spline_B_Spline || m < 1 || !sized(size, Tick_Size, Tick_Train, m))
+					error = "A tick in the ride log is damaged";
+				else
+					frameAt.push_back(at);
+			}
+		}
+		else if (type == Chunk_Keyframe)
+		{
+			if (size < Key_Size)
+				error = "A keyframe in the ride log is damaged";
+			else {
+				Keyframe k;
+				k.frame = (long) frameAt.size() - 1;
+				k.at = at;
+				q += sizeof(unsigned);
+				const unsigned spline = get<unsigned char>(q);
+				q += 1;
+				k.edited = get<unsigned char>(q) == Key_Edited;
+				q += 1 + 3 * sizeof(float);
+				const unsigned long long trackAt = get<unsigned long long>(q);
+				const size_t m = get<unsigned>(q);
+				k.trackAt = (size_t) trackAt;
+				if (spline > Spline_B_Spline || m < 1 || !sized(size, Key_Size, Key_Train, m))
+					error = "A keyframe in the ride log is damaged";
+				else if (trackAt != k.trackAt ||
+							!std::binary_search(tracks.begin(), tracks.end(), k.trackAt))
+					error = "A keyframe in the ride log has no track";
+				else if (!frameAt.empty())
+					keys.push_back(k);
+			}
+		}
+		p += size;
+	}
+
+	if (error) {
+		if (why) *why = error;
+		close();
+		return false;
+	}
+	if (keys.empty() || keys[0].frame != 0) {
+		if (why) *why = "The ride log has no keyframe to start from";
+		close();
+		return false;
+	}
+	return true;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void RideReplay::
+close()
+//============================================================================
+{
+	data.clear();
+	frameAt.clear();
+	keys.clear();
+	current = -1;
+	loadedTrack = 0;
+	mismatch = 0;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+bool RideReplay::
+playing() const
+//============================================================================
+{
+	return !keys.empty();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+long RideReplay::
+frames() const
+//============================================================================
+{
+	return (long) frameAt.size();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+long RideReplay::
+frame() const
+//============================================================================
+{
+	return current;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+int RideReplay::
+keyAt(const long f) const
+//============================================================================
+{
+	Keyframe k;
+	k.frame = f;
+	std::vector<Keyframe>::const_iterator i = std::lower_bound(keys.begin(), keys.end(), k,
+		[](const Keyframe& a, const Keyframe& b) { return a.frame < b.frame; });
+	return i != keys.end() && i->frame == f ? (int) (i - keys.begin()) : -1;
+}
+
+//****************************************************************************
+//
+// * the track is only read again if it is a different one
+//============================================================================
+void RideReplay::
+restore(const Keyframe& key, CTrack& track, int& spline, TrainSim& sim)
+//============================================================================
+{
+	if (key.trackAt != loadedTrack)
+	{
+		size_t p = key.trackAt + Chunk_Header;
+		const unsigned count = get<unsigned>(p);
+		track.points.resize(count);
+		for (unsigned i = 0; i < count; ++i)
+		{
+			float v[6];
+			memcpy(v, &data[p], sizeof(v));
+			p += sizeof(v);
+			track.points[i] = ControlPoint(Pnt3f(v[0], v[1], v[2]), Pnt3f(v[3], v[4], v[5]));
+		}
+		track.touch();
+		loadedTrack = key.trackAt;
+	}
+
+	size_t p = key.at + Chunk_Header + sizeof(unsigned);
+	spline = get<unsigned char>(p);
+	setSimFlags(sim, get<unsigned char>(p));
+	p += 2;
+	sim.headway = get<float>(p);
+	sim.friction = get<float>(p);
+	sim.drag = get<float>(p);
+	p += sizeof(unsigned long long);
+
+	const int m = (int) get<unsigned>(p);
+	while (sim.trains() < m)
+		sim.addTrain(0);
+	while (sim.trains() > m && sim.trains() > 1)
+		sim.removeTrain();
+
+	for (int t = 0; t < m && t < sim.trains(); ++t)
+	{
+		sim.speed[t] = get<float>(p);
+		sim.weight[t] = get<float>(p);
+		sim.setCars(t, get<int>(p));
+		sim.head[t] = get<double>(p);
+		sim.distance[t] = get<double>(p);
+		sim.velocity[t] = get<float>(p);
+		sim.energy[t] = get<float>(p);
+	}
+	sim.resume(track, spline);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void RideReplay::
+simulate(const long f, const CTrack& track, int& spline, TrainSim& sim)
+//============================================================================
+{
+	size_t p = frameAt[f] + Chunk_Header + sizeof(unsigned);
+	const float dir = get<signed char>(p) < 0 ? -1.0f : 1.0f;
+	spline = get<unsigned char>(p);
+	setSimFlags(sim, get<unsigned char>(p));
+	p += 1;
+	sim.speed[0] = get<float>(p);
+
+	sim.advance(track, spline, dir);
+
+	const int m = (int) get<unsigned>(p);
+	for (int t = 0; t < m && t < sim.trains(); ++t)
+	{
+		const double d = get<double>(p);
+		p += sizeof(float);
+
+		double error = fabs(sim.distance[t] - d);
+		const double total = sim.table.length();
+		if (error > total / 2)
+			error = total - error;
+		if (error > mismatch)
+			mismatch = error;
+	}
+}
+
+//****************************************************************************
+//
+// * the ticks in between never have keyframes, so nothing was edited there
+//============================================================================
+bool RideReplay::
+seek(const long f, CTrack& track, int& spline, TrainSim& sim)
+//============================================================================
+{
+	if (f < 0 || f >= frames())
+		return false;
+
+	Keyframe k;
+	k.frame = f;
+	std::vector<Keyframe>::const_iterator i = std::upper_bound(keys.begin(), keys.end(), k,
+		[](const Keyframe& a, const Keyframe& b) { return a.frame < b.frame; });
+	--i;		// the first keyframe is at frame 0
+
+	restore(*i, track, spline, sim);
+	for (long g = i->frame + 1; g <= f; ++g)
+		simulate(g, track, spline, sim);
+	current = f;
+	return true;
+}
+
+//****************************************************************************
+//
+// * a keyframe is taken over after the tick, it is exactly what the tick
+//   should have come to - unless something was edited before it, then
+//   the tick can't be run again and the keyframe is all there is
+//============================================================================
+bool RideReplay::
+next(CTrack& track, int& spline, TrainSim& sim)
+//============================================================================
+{
+	const long f = current + 1;
+	if (f >= frames())
+		return false;
+
+	const int k = keyAt(f);
+	if (k < 0 || !keys[k].edited)
+		simulate(f, track, spline, sim);
+	if (k >= 0)
+		restore(keys[k], track, spline, sim);
+	current = f;
+	return true;
+}
@@ -0,0 +1,1498 @@
+/************************************************************************
+     File:        RideTool.cpp
+
+     Comment:     Command line tools for tracks, no window needed
+
+						RideTool analyze <dir|file>... [options]
+							simulate a lap of every track file (*.txt) and
+							write one row of ride statistics per track
+							--out <file>		write there instead of stdout
+							--json				one JSON object per line, not CSV
+							--threads <n>		worker threads (default: all cores)
+							--spline <linear|cardinal|bspline>
+							--cars <n>
+							--speed <v>			the speed slider, 0 to 10
+							--no-physics
+							--no-arclength
+							--max-time <sec>	give up on a lap after this long
+
+						RideTool energy <dir|file>... [options]
+							let the train roll freely (no drive, friction or
+							drag) and check every tick against the same tick
+							rolled in small steps down the slope of the
+							heights, exits with 1 if any track is off too far
+							--ticks <n>			how long to roll (default 100000)
+							--tolerance <f>	largest difference of kinetic
+													energy allowed, relative to
+													the energy (default 1e-4)
+							--spline <linear|cardinal|bspline>
+							--cars <n>
+
+						RideTool bench <file> [options]
+							time the simulation of long trains, the track is
+							scaled up until all of the cars fit on it
+							--cars <n>			cars per train (default 1000)
+							--trains <n>		(default 1)
+							--ticks <n>			(default 1000)
+							--spline <linear|cardinal|bspline>
+
+						RideTool drift <file> [options]
+							run the train at a constant speed with arc length
+							and check that it ends up exactly as far as it
+							should, and that its head parameter still says
+							where it is, exits with 1 if not
+							--ticks <n>			(default 1000000)
+							--speed <v>			the speed slider (default 2)
+							--tolerance <f>	largest error allowed, in
+													distance (default 1e-3)
+							--spline <linear|cardinal|bspline>
+
+						RideTool record <file> --out <log> [options]
+							run the sim on the track and record the ride
+							--ticks <n>			(default 10000)
+							--trains <n>		(default 1)
+							--cars <n>
+							--speed <v>
+							--no-physics
+							--no-arclength
+							--spline <linear|cardinal|bspline>
+
+						RideTool replay <log> [options]
+							play a recorded ride back, then seek around in it,
+							exits with 1 if it doesn't come out as recorded
+							--seeks <n>			(default 100)
+
+						RideTool clearance <file> [options]
+							sweep the envelope of a car along the track and list
+							the places it runs into itself, then drag points
+							around and time the incremental checks, exits with 1
+							if they don't agree with checking from scratch
+							--drags <n>		points to drag (default 20)
+							--frames <n>		frames per drag (default 30)
+							--spline <linear|cardinal|bspline>
+
+						RideTool history <file> [options]
+							make random edits of the points through the undo
+							history, undo all of them and redo them again,
+							exits with 1 if the track doesn't come back exactly
+							as it was after every step
+							--commands <n>		(default 1000)
+
+						RideTool edit <file> <commands> [options]
+							run a command file of edits (see TrackEdit.H) on
+							the track as one batch, then through the undo
+							history, exits with 1 if a command fails or undo
+							and redo don't give the tracks back exactly
+							--out <file>		write the edited track there
+							--spline <linear|cardinal|bspline>
+													for resample (default cardinal)
+
+						RideTool rebuild <file> [options]
+							time measuring the track and sweeping it for
+							clearance from scratch, on the shared job pool
+							--threads <n>		(default: all cores)
+							--repeat <n>		(default 5)
+							--spline <linear|cardinal|bspline>
+
+						RideTool channel <file> [options]
+							run the sim on a thread of its own, publishing the
+							cars through a TripleBuffer, and read them on this
+							one as fast as it goes, exits with 1 if a read
+							ever gets two ticks mixed up
+							--rate <hz>			ticks per second (default 1000)
+							--seconds <s>		(default 5)
+							--fps <n>			reads per second (default 0, as
+													fast as it goes)
+							--trains <n>		(default 3)
+							--cars <n>			(default 10)
+							--spline <linear|cardinal|bspline>
+
+						RideTool run <file> [options]
+							keep the trains going for hours without rendering,
+							as fast as it goes or paced, and report the laps,
+							speeds and spacing of every train
+							--hours <h>			how long to simulate (default 1)
+							--ticks <n>			or this many ticks
+							--rate <x>			x times real time (default 0, as
+													fast as it goes)
+							--report <sec>		progress every sec simulated
+							--trains <n>
+							--cars <n>
+							--speed <v>
+							--no-physics
+							--no-arclength
+							--brakes
+							--record <log>		record the run too
+							--telemetry <file>	write what the riders of train 0
+													feel every tick (CSV)
+							--binary			columns of floats instead of CSV
+							--spline <linear|cardinal|bspline>
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ArcLength.H"
+#include "Channel.H"
+#include "Clearance.H"
+#include "EditHistory.H"
+#include "Jobs.H"
+#include "RideAnalysis.H"
+#include "RideLog.H"
+#include "Spline.H"
+#include "Telemetry.H"
+#include "TrackEdit.H"
+
+// steps of the reference ride per tick of the sim (see energy)
+static const int Energy_Steps = 64;
+// meters to either side for the slope of the reference ride
+static const double Energy_Reach = 0.01;
+
+//****************************************************************************
+//
+// *
+//============================================================================
+static void usage()
+//============================================================================
+{
+	fprintf(stderr,
+		"usage: RideTool analyze <dir|file>... [--out file] [--json] [--threads n]\n"
+		"                [--spline linear|cardinal|bspline] [--cars n] [--speed v]\n"
+		"                [--no-physics] [--no-arclength] [--max-time sec]\n"
+		"       RideTool energy <dir|file>... [--ticks n] [--tolerance f]\n"
+		"                [--spline linear|cardinal|bspline] [--cars n]\n"
+		"       RideTool bench <file> [--cars n] [--trains n] [--ticks n]\n"
+		"                [--spline linear|cardinal|bspline]\n"
+		"       RideTool drift <file> [--ticks n] [--speed v] [--tolerance f]\n"
+		"                [--spline linear|cardinal|bspline]\n"
+		"       RideTool record <file> --out log [--ticks n] [--trains n] [--cars n]\n"
+		"                [--speed v] [--no-physics] [--no-arclength]\n"
+		"                [--spline linear|cardinal|bspline]\n"
+		"       RideTool replay <log> [--seeks n]\n"
+		"       RideTool run <file> [--hours h] [--ticks n] [--rate x] [--report sec]\n"
+		"                [--trains n] [--cars n] [--speed v] [--no-physics]\n"
+		"                [--no-arclength] [--brakes] [--record log]\n"
+		"                [--telemetry file] [--binary] [--spline linear|cardinal|bspline]\n"
+		"       RideTool clearance <file> [--drags n] [--frames n]\n"
+		"                [--spline linear|cardinal|bspline]\n"
+		"       RideTool history <file> [--commands n]\n"
+		"       RideTool edit <file> <commands> [--out file]\n"
+		"                [--spline linear|cardinal|bspline]\n"
+		"       RideTool rebuild <file> [--threads n] [--repeat n]\n"
+		"                [--spline linear|cardinal|bspline]\n"
+		"       RideTool channel <file> [--rate hz] [--seconds s] [--fps n]\n"
+		"                [--trains n] [--cars n] [--spline linear|cardinal|bspline]\n");
+}
+
+//****************************************************************************
+//
+// * add a file, or all of the *.txt files in a directory
+//============================================================================
+static void addTrackFiles(const char* path, std::vector<std::string>& files)
+//============================================================================
+{
+	struct stat st;
+	if (stat(path, &st) != 0) {
+		fprintf(stderr, "Can't find %s\n", path);
+		return;
+	}
+	if (!S_ISDIR(st.st_mode)) {
+		files.push_back(path);
+		return;
+	}
+
+	DIR* dir = opendir(path);
+	if (!dir)
+		return;
+
+	std::vector<std::string> found;
+	while (struct dirent* e = readdir(dir)) {
+		const size_t len = strlen(e->d_name);
+		if (len > 4 && !strcmp(e->d_name + len - 4, ".txt"))
+			found.push_back(std::string(path) + "/" + e->d_name);
+	}
+	closedir(dir);
+
+	// the directory order isn't anything in particular
+	std::sort(found.begin(), found.end());
+	files.insert(files.end(), found.begin(), found.end());
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+static int parseSpline(const char* name)
+//============================================================================
+{
+	if (!strcmp(name, "linear"))		return Spline_Linear;
+	if (!strcmp(name, "cardinal"))	return Spline_Cardinal;
+	if (!strcmp(name, "bspline"))		return Spline_B_Spline;
+	return Spline_None;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+static int analyze(int argc, char** argv)
+//============================================================================
+{
+	RideOptions options;
+	std::vector<std::string> files;
+	const char* out = 0;
+	bool json = false;
+	unsigned threads = 0;
+
+	for (int i = 0; i < argc; ++i) {
+		const char* a = argv[i];
+		const bool more = i + 1 < argc;
+		if (!strcmp(a, "--out") && more)
+			out = argv[++i];
+		else if (!strcmp(a, "--json"))
+			json = true;
+		else if (!strcmp(a, "--threads") && more)
+			threads = (unsigned) atoi(argv[++i]);
+		else if (!strcmp(a, "--spline") && more) {
+			options.spline = parseSpline(argv[++i]);
+			if (options.spline == Spline_None) {
+				fprintf(stderr, "Unknown spline type %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (!strcmp(a, "--cars") && more) {
+			options.settings.setCars(0, atoi(argv[++i]));
+		}
+		else if (!strcmp(a, "--speed") && more)
+			options.settings.speed[0] = (float) atof(argv[++i]);
+		else if (!strcmp(a, "--no-physics"))
+			options.settings.physics = false;
+		else if (!strcmp(a, "--no-arclength"))
+			options.settings.arcLength = false;
+		else if (!strcmp(a, "--max-time") && more)
+			options.maxTime = (float) atof(argv[++i]);
+		else if (a[0] == '-') {
+			usage();
+			return 1;
+		}
+		else
+			addTrackFiles(a, files);
+	}
+
+	if (files.empty()) {
+		fprintf(stderr, "No track files\n");
+		return 1;
+	}
+
+	FILE* fp = out ? fopen(out, "w") : stdout;
+	if (!fp) {
+		fprintf(stderr, "Can't write %s\n", out);
+		return 1;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<RideStats> stats;
+	analyzeRides(files, options, stats, threads);
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if (!json)
+		writeRideCSVHeader(fp);
+	for (size_t i = 0; i < files.size(); ++i) {
+		if (json)
+			writeRideJSON(fp, files[i], stats[i]);
+		else
+			writeRideCSV(fp, files[i], stats[i]);
+	}
+	if (out)
+		fclose(fp);
+
+	fprintf(stderr, "%u tracks in %.3f s (%.1f tracks/sec)\n",
+			  (unsigned) files.size(), seconds, seconds > 0 ? files.size() / seconds : 0.0);
+	return 0;
+}
+
+//****************************************************************************
+//
+// * the slope under the cars of train 0 with its head at d (the average,
+//   as the sim takes it) - from the heights a little to either side, not
+//   the slopes of the table: those are smoothed, the energy the sim keeps
+//   goes with the heights
+//============================================================================
+static double slopeUnder(const TrainSim& sim, const double d)
+//============================================================================
+{
+	const double pitch = Train_Length + Train_Gap;
+	const int m = sim.placed[0] > 0 ? sim.placed[0] : 1;
+	double a = 0;
+	for (int k = 0; k < m; ++k) {
+		const double at = d - k * pitch;
+		a += (sim.table.height(at + Energy_Reach) - sim.table.height(at - Energy_Reach)) /
+			  (2 * Energy_Reach);
+	}
+	return a / m;
+}
+
+//****************************************************************************
+//
+// * roll train 0 from distance d at speed v for dt, in Energy_Steps
+//   Runge-Kutta steps of dd/dt = v, dv/dt = -g slope
+//============================================================================
+static void rollSteps(const TrainSim& sim, double& d, double& v, const double dt)
+//============================================================================
+{
+	const double h = dt / Energy_Steps;
+	for (int k = 0; k < Energy_Steps; ++k) {
+		const double v1 = v, a1 = -Gravity * slopeUnder(sim, d);
+		const double v2 = v + 0.5 * h * a1, a2 = -Gravity * slopeUnder(sim, d + 0.5 * h * v1);
+		const double v3 = v + 0.5 * h * a2, a3 = -Gravity * slopeUnder(sim, d + 0.5 * h * v2);
+		const double v4 = v + h * a3, a4 = -Gravity * slopeUnder(sim, d + h * v3);
+		d += h * (v1 + 2 * v2 + 2 * v3 + v4) / 6;
+		v += h * (a1 + 2 * a2 + 2 * a3 + a4) / 6;
+	}
+}
+
+//****************************************************************************
+//
+// * roll every track without any losses, and check every tick against the
+//   same ride worked out from the slope of the track in small steps
+//============================================================================
+static int energy(int argc, char** argv)
+//============================================================================
+{
+	std::vector<std::string> files;
+	int spline = Spline_Cardinal;
+	int cars = 1;
+	long ticks = 100000;
+	float tolerance = 1e-4f;
+
+	for (int i = 0; i < argc; ++i) {
+		const char* a = argv[i];
+		const bool more = i + 1 < argc;
+		if (!strcmp(a, "--ticks") && more)
+			ticks = atol(argv[++i]);
+		else if (!strcmp(a, "--tolerance") && more)
+			tolerance = (float) atof(argv[++i]);
+		else if (!strcmp(a, "--spline") && more) {
+			spline = parseSpline(argv[++i]);
+			if (spline == Spline_None) {
+				fprintf(stderr, "Unknown spline type %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (!strcmp(a, "--cars") && more)
+			cars = atoi(argv[++i]);
+		else if (a[0] == '-') {
+			usage();
+			return 1;
+		}
+		else
+			addTrackFiles(a, files);
+	}
+
+	if (files.empty()) {
+		fprintf(stderr, "No track files\n");
+		return 1;
+	}
+
+	int failed = 0;
+	printf("file,energy,max_error,relative_error,max_speed_error,max_distance_error,stops,ok\n");
+	for (size_t f = 0; f < files.size(); ++f) {
+		CTrack track;
+		if (!track.readPoints(files[f].c_str()) || track.points.size() < 4) {
+			fprintf(stderr, "Can't read %s\n", files[f].c_str());
+			failed++;
+			continue;
+		}
+
+		TrainSim sim;
+		sim.setCars(0, cars);
+		sim.speed[0] = 0;
+		sim.friction = 0;
+		sim.drag = 0;
+
+		sim.advance(track, spline);
+		const float e0 = sim.measureEnergy(0);
+		const double total = sim.table.length();
+
+		// every tick again from where the sim started it, in small steps of
+		// dv/dt = -g slope - nothing of the energy the sim keeps. they are
+		// compared by the kinetic energy (per unit of mass) they end up
+		// with: near the top of a hill a tiny difference of energy is a big
+		// one of speed. the ticks where the sim stops at the top (and rolls
+		// back from there) are left out, it doesn't go past it on purpose
+		double worst = 0, worstAt = 0, worstSpeed = 0;
+		long stops = 0;
+		for (long t = 0; t < ticks; ++t) {
+			const double d0 = sim.distance[0];
+			const double v0 = sim.velocity[0];
+			sim.advance(track, spline);
+			if (sim.velocity[0] == 0) {
+				++stops;
+				continue;
+			}
+
+			double d = d0, v = v0;
+			rollSteps(sim, d, v, 1.0 / Tick_Rate);
+			double apart = fmod(fabs(sim.distance[0] - d), total);
+			apart = std::min(apart, total - apart);
+			const double vs = sim.velocity[0];
+			worst = std::max(worst, 0.5 * fabs(vs * vs - v * v));
+			worstAt = std::max(worstAt, apart);
+			worstSpeed = std::max(worstSpeed, fabs(vs - v));
+		}
+
+		const double relative = e0 != 0 ? worst / fabs(e0) : worst;
+		const bool ok = relative <= tolerance;
+		if (!ok)
+			failed++;
+		printf("\"%s\",%g,%g,%g,%g,%g,%ld,%d\n", files[f].c_str(), e0, worst, relative,
+				 worstSpeed, worstAt, stops, ok ? 1 : 0);
+	}
+
+	if (failed)
+		fprintf(stderr, "%d of %u tracks failed\n", failed, (unsigned) files.size());
+	return failed ? 1 : 0;
+}
+
+//****************************************************************************
+//
+// * time the simulation of long trains
+//============================================================================
+static int bench(int argc, char** argv)
+//============================================================================
+{
+	const char* file = 0;
+	int spline = Spline_Cardinal;
+	int cars = 1000;
+	int trains = 1;
+	long ticks = 1000;
+
+	for (int i = 0; i < argc; ++i) {
+		const char* a = argv[i];
+		const bool more = i + 1 < argc;
+		if (!strcmp(a, "--cars") && more)
+			cars = atoi(argv[++i]);
+		else if (!strcmp(a, "--trains") && more)
+			trains = atoi(argv[++i]);
+		else if (!strcmp(a, "--ticks") && more)
+			ticks = atol(argv[++i]);
+		else if (!strcmp(a, "--spline") && more) {
+			spline = parseSpline(argv[++i]);
+			if (spline == Spline_None) {
+				fprintf(stderr, "Unknown spline type %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (a[0] == '-' || file) {
+			usage();
+			return 1;
+		}
+		else
+			file = a;
+	}
+
+	CTrack track;
+	const char* why = 0;
+	if (!file || !track.readPoints(file, &why) || track.points.size() < 4) {
+		fprintf(stderr, "Can't read %s %s\n", file ? file : "", why ? why : "");
+		return 1;
+	}
+
+	// blow the track up until all of the trains fit on it, with a gap of a
+	// train between them
+	TrainSim sim;
+	sim.table.build(track.points, spline);
+	const float needed = 2.0f * trains * cars * (Train_Length + Train_Gap);
+	float scale = 1;
+	if (sim.table.length() > 0 && sim.table.length() < needed) {
+		scale = needed / sim.table.length();
+		for (size_t i = 0; i < track.points.size(); ++i)
+			track.points[i].pos = track.points[i].pos * scale;
+		track.touch();
+	}
+
+	sim.setCars(0, cars);
+	for (int t = 1; t < trains; ++t)
+		sim.addTrain(0, cars);
+	sim.rewind(track);
+	sim.advance(track, spline);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (long t = 0; t < ticks; ++t)
+		sim.advance(track, spline);
+	const double advanceSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	start = std::chrono::steady_clock::now();
+	for (long t = 0; t < ticks; ++t)
+		sim.placeCars(track, spline);
+	const double placeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	long placed = 0;
+	for (int t = 0; t < sim.trains(); ++t)
+		placed += sim.placed[t];
+
+	printf("track %s scaled %gx, %d trains of %d cars (%ld placed), %ld ticks\n",
+			 file, scale, trains, cars, placed, ticks);
+	printf("advance: %.3f us / tick, %.1f ns / car, %.0f ticks / sec\n",
+			 1e6 * advanceSeconds / ticks, 1e9 * advanceSeconds / ticks / placed,
+			 advanceSeconds > 0 ? ticks / advanceSeconds : 0.0);
+	printf("place:   %.3f us / tick, %.1f ns / car\n",
+			 1e6 * placeSeconds / ticks, 1e9 * placeSeconds / ticks / placed);
+	printf("arc length table: %ld curve evaluations, %.1f per segment\n",
+			 sim.table.evaluations, (double) sim.table.evaluations / track.points.size());
+	return 0;
+}
+
+//****************************************************************************
+//
+// * without physics every tick is the same step of distance, so after k
+//   ticks the train has to be k steps from where it started
+//============================================================================
+static int drift(int argc, char** argv)
+//============================================================================
+{
+	const char* file = 0;
+	int spline = Spline_Cardinal;
+	long ticks = 1000000;
+	float speed = 2;
+	double tolerance = 1e-3;
+
+	for (int i = 0; i < argc; ++i) {
+		const char* a = argv[i];
+		const bool more = i + 1 < argc;
+		if (!strcmp(a, "--ticks") && more)
+			ticks = atol(argv[++i]);
+		else if (!strcmp(a, "--speed") && more)
+			speed = (float) atof(argv[++i]);
+		else if (!strcmp(a, "--tolerance") && more)
+			tolerance = atof(argv[++i]);
+		else if (!strcmp(a, "--spline") && more) {
+			spline = parseSpline(argv[++i]);
+			if (spline == Spline_None) {
+				fprintf(stderr, "Unknown spline type %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (a[0] == '-' || file) {
+			usage();
+			return 1;
+		}
+		else
+			file = a;
+	}
+
+	CTrack track;
+	const char* why = 0;
+	if (!file || !track.readPoints(file, &why) || track.points.size() < 4) {
+		fprintf(stderr, "Can't read %s %s\n", file ? file : "", why ? why : "");
+		return 1;
+	}
+
+	TrainSim sim;
+	sim.physics = false;
+	sim.arcLength = true;
+	sim.speed[0] = speed;
+	sim.placeCars(track, spline);
+
+	const double total = sim.table.length();
+	const double start = sim.distance[0];
+	double step = -1;
+	double maxDrift = 0;		// how far the distance is from k steps
+	double maxSlip = 0;		// how far the head is from the distance
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	for (long k = 1; k <= ticks; ++k) {
+		const double before = sim.distance[0];
+		sim.advance(track, spline);
+
+		// the step the sim takes, as it works it out
+		if (step < 0) {
+			step = sim.distance[0] - before;
+			if (step < 0)
+				step += total;
+		}
+
+		double error = fabs(fmod(start + k * step, total) - sim.distance[0]);
+		if (error > total / 2)
+			error = total - error;
+		if (error > maxDrift)
+			maxDrift = error;
+
+		double slip = fabs(sim.table.distance(sim.head[0]) - sim.distance[0]);
+		if (slip > total / 2)
+			slip = total - slip;
+		if (slip > maxSlip)
+			maxSlip = slip;
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	const bool ok = maxDrift <= tolerance && maxSlip <= tolerance;
+	printf("track %s: %u points, length %g, step %g, %ld ticks (%.1f laps) in %.2f s\n",
+			 file, (unsigned) track.points.size(), total, step, ticks,
+			 total > 0 ? ticks * step / total : 0.0, seconds);
+	printf("max drift %g, max head slip %g: %s\n", maxDrift, maxSlip, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+//****************************************************************************
+//
+// * run the sim on a track and record it
+//============================================================================
+static int record(int argc, char** argv)
+//============================================================================
+{
+	const char* file = 0;
+	const char* out = 0;
+	int spline = Spline_Cardinal;
+	long ticks = 10000;
+	int trains = 1;
+	TrainSim sim;
+
+	for (int i = 0; i < argc; ++i) {
+		const char* a = argv[i];
+		const bool more = i + 1 < argc;
+		if (!strcmp(a, "--out") && more)
+			out = argv[++i];
+		else if (!strcmp(a, "--ticks") && more)
+			ticks = atol(argv[++i]);
+		else if (!strcmp(a, "--trains") && more)
+			trains = atoi(argv[++i]);
+		else if (!strcmp(a, "--cars") && more)
+			sim.setCars(0, atoi(argv[++i]));
+		else if (!strcmp(a, "--speed") && more)
+			sim.speed[0] = (float) atof(argv[++i]);
+		else if (!strcmp(a, "--no-physics"))
+			sim.physics = false;
+		else if (!strcmp(a, "--no-arclength"))
+			sim.arcLength = false;
+		else if (!strcmp(a, "--spline") && more) {
+			spline = parseSpline(argv[++i]);
+			if (spline == Spline_None) {
+				fprintf(stderr, "Unknown spline type %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (a[0] == '-' || file) {
+			usage();
+			return 1;
+		}
+		else
+			file = a;
+	}
+
+	CTrack track;
+	const char* why = 0;
+	if (!file || !out || !track.readPoints(file, &why) || track.points.size() < 4) {
+		fprintf(stderr, "Can't read %s %s\n", file ? file : "", why ? why : "");
+		return 1;
+	}
+
+	for (int t = 1; t < trains; ++t)
+		sim.addTrain(0, sim.cars[0], sim.speed[0] * (0.5f + 0.1f * t));
+	sim.rewind(track);
+
+	RideRecorder recorder;
+	if (!recorder.start(out, &why)) {
+		fprintf(stderr, "Can't write %s: %s\n", out, why);
+		return 1;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (long t = 0; t < ticks; ++t) {
+		sim.advance(track, spline);
+		recorder.tick(sim, track, spline, 1);
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	recorder.stop();
+
+	printf("%ld ticks recorded (%ld keyframes, %ld dropped) into %s, %.3f us / tick\n",
+			 recorder.ticks, recorder.keyframes, recorder.dropped, out, 1e6 * seconds / ticks);
+	return recorder.dropped ? 1 : 0;
+}
+
+//****************************************************************************
+//
+// * play a recording through, then seek around in it - every seek has to
+//   come to the same place the playback did
+//============================================================================
+static int replay(int argc, char** argv)
+//============================================================================
+{
+	const char* file = 0;
+	int seeks = 100;
+
+	for (int i = 0; i < argc; ++i) {
+		const char* a = argv[i];
+		const bool more = i + 1 < argc;
+		if (!strcmp(a, "--seeks") && more)
+			seeks = atoi(argv[++i]);
+		else if (a[0] == '-' || file) {
+			usage();
+			return 1;
+		}
+		else
+			file = a;
+	}
+
+	RideReplay replay;
+	const char* why = 0;
+	if (!file || !replay.open(file, &why)) {
+		fprintf(stderr, "Can't read %s %s\n", file ? file : "", why ? why : "");
+		return 1;
+	}
+
+	CTrack track;
+	TrainSim sim;
+	int spline = Spline_Cardinal;
+
+	// where the head of train 0 is at every frame
+	std::vector<double> played;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	replay.seek(0, track, spline, sim);
+	played.push_back(sim.distance[0]);
+	while (replay.next(track, spline, sim))
+		played.push_back(sim.distance[0]);
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	double seekError = 0;
+	start = std::chrono::steady_clock::now();
+	srand(1);
+	for (int i = 0; i < seeks; ++i) {
+		const long f = rand() % replay.frames();
+		replay.seek(f, track, spline, sim);
+		seekError = std::max(seekError, fabs(sim.distance[0] - played[f]));
+	}
+	const double seekSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	const bool ok = replay.mismatch == 0 && seekError == 0;
+	printf("%s: %ld frames played in %.3f s (%.0f ticks / sec), %d seeks %.3f ms each\n",
+			 file, replay.frames(), seconds, seconds > 0 ? replay.frames() / seconds : 0.0,
+			 seeks, seeks > 0 ? 1e3 * seekSeconds / seeks : 0.0);
+	printf("largest difference from the recording %g, between seeking and playing %g: %s\n",
+			 replay.mismatch, seekError, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+//****************************************************************************
+//
+// * keep the trains going for a long time, in pieces of one report each
+//============================================================================
+static int run(int argc, char** argv)
+//============================================================================
+{
+	const char* file = 0;
+	const char* log = 0;
+	const char* tel = 0;
+	bool binary = false;
+	int spline = Spline_Cardinal;
+	double hours = 1;
+	long ticks = 0;
+	double rate = 0;
+	double report = 600;
+	int trains = 1;
+	TrainSim sim;
+
+	for (int i = 0; i < argc; ++i) {
+		const char* a = argv[i];
+		const bool more = i + 1 < argc;
+		if (!strcmp(a, "--hours") && more)
+			hours = atof(argv[++i]);
+		else if (!strcmp(a, "--ticks") && more)
+			ticks = atol(argv[++i]);
+		else if (!strcmp(a, "--rate") && more)
+			rate = atof(argv[++i]);
+		else if (!strcmp(a, "--report") && more)
+			report = atof(argv[++i]);
+		else if (!strcmp(a, "--record") && more)
+			log = argv[++i];
+		else if (!strcmp(a, "--telemetry") && more)
+			tel = argv[++i];
+		else if (!strcmp(a, "--binary"))
+			binary = true;
+		else if (!strcmp(a, "--trains") && more)
+			trains = atoi(argv[++i]);
+		else if (!strcmp(a, "--cars") && more)
+			sim.setCars(0, atoi(argv[++i]));
+		else if (!strcmp(a, "--speed") && more)
+			sim.speed[0] = (float) atof(argv[++i]);
+		else if (!strcmp(a, "--no-physics"))
+			sim.physics = false;
+		else if (!strcmp(a, "--no-arclength"))
+			sim.arcLength = false;
+		else if (!strcmp(a, "--brakes"))
+			sim.braking = true;
+		else if (!strcmp(a, "--spline") && more) {
+			spline = parseSpline(argv[++i]);
+			if (spline == Spline_None) {
+				fprintf(stderr, "Unknown spline type %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (a[0] == '-' || file) {
+			usage();
+			return 1;
+		}
+		else
+			file = a;
+	}
+
+	CTrack track;
+	const char* why = 0;
+	if (!file || !track.readPoints(file, &why) || track.points.size() < 4) {
+		fprintf(stderr, "Can't read %s %s\n", file ? file : "", why ? why : "");
+		return 1;
+	}
+	if (ticks <= 0)
+		ticks = (long) (hours * 3600 * Tick_Rate);
+
+	// the other trains get the cars of the first one and speeds around it,
+	// like + Train does
+	for (int t = 1; t < trains; ++t)
+		sim.addTrain(0, sim.cars[0], sim.speed[0] * (0.5f + (t * 37 % 100) / 100.0f));
+	sim.rewind(track);
+
+	RideRecorder recorder;
+	if (log && !recorder.start(log, &why)) {
+		fprintf(stderr, "Can't write %s: %s\n", log, why);
+		return 1;
+	}
+	Telemetry telemetry;
+	if (tel && !telemetry.open(tel, binary, 0, &why)) {
+		fprintf(stderr, "Can't write %s: %s\n", tel, why);
+		return 1;
+	}
+
+	RunStats stats;
+	const long piece = report > 0 ? (long) (report * Tick_Rate) : ticks;
+	while (stats.ticks < ticks) {
+		runRide(track, spline, sim, std::min(piece, ticks - stats.ticks), rate, stats,
+				  log ? &recorder : 0, tel ? &telemetry : 0);
+		if (stats.ticks < ticks)
+			fprintf(stderr, "%8.1f min simulated, %.2f laps, %.0f ticks / sec\n",
+					  stats.ticks / (60.0 * Tick_Rate), stats.laps[0],
+					  stats.wallSeconds > 0 ? stats.ticks / stats.wallSeconds : 0.0);
+	}
+	recorder.stop();
+	telemetry.close(sim, track, spline);
+
+	const double simSeconds = (double) stats.ticks / Tick_Rate;
+	printf("track %s: %ld ticks (%.2f h simulated) in %.2f s, %.0f ticks / sec, %.0fx real time\n",
+			 file, stats.ticks, simSeconds / 3600, stats.wallSeconds,
+			 stats.wallSeconds > 0 ? stats.ticks / stats.wallSeconds : 0.0,
+			 stats.wallSeconds > 0 ? simSeconds / stats.wallSeconds : 0.0);
+	printf("train,laps,min_speed,max_speed,braked_ticks\n");
+	for (int t = 0; t < sim.trains(); ++t)
+		printf("%d,%.3f,%g,%g,%ld\n", t, stats.laps[t],
+				 stats.minSpeed[t] < FLT_MAX ? stats.minSpeed[t] : 0.0f, stats.maxSpeed[t],
+				 stats.brakedTicks[t]);
+	if (sim.trains() > 1)
+		printf("spacing events %ld, collisions %ld, closest gap %g\n",
+				 stats.spacingEvents, stats.collisions,
+				 stats.minGap < FLT_MAX ? stats.minGap : sim.headway);
+	if (log)
+		printf("%ld ticks recorded into %s (%ld dropped)\n", recorder.ticks, log, recorder.dropped);
+	if (tel)
+		printf("%ld telemetry samples written to %s\n", telemetry.samples, tel);
+	return 0;
+}
+
+//****************************************************************************
+//
+// * check a track for clearance, then drag points around like the window
+//   does and check on every frame
+//============================================================================
+static int clearance(int argc, char** argv)
+//============================================================================
+{
+	const char* file = 0;
+	int spline = Spline_Cardinal;
+	int drags = 20;
+	int frames = 30;
+
+	for (int i = 0; i < argc; ++i) {
+		const char* a = argv[i];
+		const bool more = i + 1 < argc;
+		if (!strcmp(a, "--drags") && more)
+			drags = atoi(argv[++i]);
+		else if (!strcmp(a, "--frames") && more)
+			frames = atoi(argv[++i]);
+		else if (!strcmp(a, "--spline") && more) {
+			spline = parseSpline(argv[++i]);
+			if (spline == Spline_None) {
+				fprintf(stderr, "Unknown spline type %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (a[0] == '-' || file) {
+			usage();
+			return 1;
+		}
+		else
+			file = a;
+	}
+
+	CTrack track;
+	const char* why = 0;
+	if (!file || !track.readPoints(file, &why) || track.points.size() < 4) {
+		fprintf(stderr, "Can't read %s %s\n", file ? file : "", why ? why : "");
+		return 1;
+	}
+
+	ClearanceChecker checker;
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	checker.update(track, spline);
+	const double full = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	const std::vector<ClearanceConflict>& found = checker.conflicts();
+	printf("track %s: %.1f long, checked in %.2f ms (%ld box tests), %d conflicts\n",
+			 file, checker.length(), 1e3 * full, checker.tests, (int) found.size());
+	for (size_t k = 0; k < found.size(); ++k)
+		printf("  %.1f - %.1f runs into %.1f - %.1f\n",
+				 found[k].from, found[k].to, found[k].otherFrom, found[k].otherTo);
+
+	// a point goes a few units each frame, like under the mouse
+	srand(1);
+	const int n = (int) track.points.size();
+	double worst = 0, spent = 0;
+	long updates = 0;
+	for (int d = 0; d < drags; ++d)
+	{
+		ControlPoint& cp = track.points[rand() % n];
+		const Pnt3f step((rand() % 200 - 100) / 50.0f, (rand() % 200 - 100) / 100.0f, (rand() % 200 - 100) / 50.0f);
+		for (int f = 0; f < frames; ++f)
+		{
+			cp.pos = cp.pos + step;
+			track.touch();
+			begin = std::chrono::steady_clock::now();
+			checker.update(track, spline);
+			checker.conflicts();
+			const double took = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+			worst = std::max(worst, took);
+			spent += took;
+			++updates;
+		}
+	}
+	if (updates == 0)
+		return 0;
+
+	ClearanceChecker fresh;
+	fresh.update(track, spline);
+	const std::vector<ClearanceConflict>& a = checker.conflicts();
+	const std::vector<ClearanceConflict>& b = fresh.conflicts();
+	bool same = a.size() == b.size();
+	for (size_t k = 0; same && k < a.size(); ++k)
+		same = a[k].from == b[k].from && a[k].to == b[k].to &&
+				 a[k].otherFrom == b[k].otherFrom && a[k].otherTo == b[k].otherTo;
+
+	printf("%ld dragged frames: %.3f ms on average, %.3f ms at most, %d conflicts after, %s\n",
+			 updates, 1e3 * spent / updates, 1e3 * worst, (int) a.size(),
+			 same ? "same as from scratch" : "NOT the same as from scratch");
+	return same ? 0 : 1;
+}
+
+//****************************************************************************
+//
+// * a hash of all of the points (FNV-1a over the floats)
+//============================================================================
+static unsigned long long pointsHash(const std::vector<ControlPoint>& points)
+//============================================================================
+{
+	unsigned long long h = 14695981039346656037ULL;
+	for (size_t k = 0; k < points.size(); ++k)
+	{
+		const float f[6] = { points[k].pos.x, points[k].pos.y, points[k].pos.z,
+									points[k].orient.x, points[k].orient.y, points[k].orient.z };
+		const unsigned char* b = (const unsigned char*) f;
+		for (size_t i = 0; i < sizeof(f); ++i)
+			h = (h ^ b[i]) * 1099511628211ULL;
+	}
+	return h ^ points.size();
+}
+
+//****************************************************************************
+//
+// * random commands like the window makes them (a button press, a drag of
+//   many frames, adding or deleting a point), the track is hashed after
+//   each one and has to hash the same whenever undo / redo get back there
+//============================================================================
+static int history(int argc, char** argv)
+//============================================================================
+{
+	const char* file = 0;
+	int count = 1000;
+
+	for (int i = 0; i < argc; ++i) {
+		const char* a = argv[i];
+		const bool more = i + 1 < argc;
+		if (!strcmp(a, "--commands") && more)
+			count = atoi(argv[++i]);
+		else if (a[0] == '-' || file) {
+			usage();
+			return 1;
+		}
+		else
+			file = a;
+	}
+
+	CTrack track;
+	const char* why = 0;
+	if (!file || !track.readPoints(file, &why) || track.points.size() < 4) {
+		fprintf(stderr, "Can't read %s %s\n", file ? file : "", why ? why : "");
+		return 1;
+	}
+
+	EditHistory edits;
+	std::vector<unsigned long long> hashes(1, pointsHash(track.points));
+	long changes = 0;
+
+	srand(1);
+	for (int c = 0; c < count; ++c)
+	{
+		const int n = (int) track.points.size();
+		const int what = rand() % 10;
+		const int at = rand() % n;
+		if (what < 5) {
+			// a drag, the same point on every frame
+			const Pnt3f step((rand() % 200 - 100) / 50.0f, (rand() % 200 - 100) / 100.0f, (rand() % 200 - 100) / 50.0f);
+			const int frames = 1 + rand() % 30;
+			for (int f = 0; f < frames; ++f) {
+				ControlPoint p = track.points[at];
+				p.pos = p.pos + step;
+				edits.move(track, at, p);
+			}
+		}
+		else if (what < 7) {
+			ControlPoint p = track.points[at];
+			p.orient = Pnt3f(p.orient.x + 0.1f, p.orient.y, p.orient.z - 0.1f);
+			p.orient.normalize();
+			edits.move(track, at, p);
+		}
+		else if (what < 9 || n <= 4)
+			edits.insert(track, at, ControlPoint((track.points[at].pos + track.points[(at + n - 1) % n].pos) * .5f));
+		else
+			edits.erase(track, at);
+		edits.commit();
+		hashes.push_back(pointsHash(track.points));
+	}
+
+	// (only the undo / redo is timed, not the hash)
+	int wrong = 0;
+	double undoing = 0, redoing = 0;
+	for (int c = count; c > 0; --c) {
+		const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		const bool done = edits.undo(track);
+		undoing += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		if (!done)
+			break;
+		wrong += pointsHash(track.points) != hashes[c - 1];
+		++changes;
+	}
+	const bool all = changes == count && !edits.canUndo();
+
+	for (int c = 1; c <= count; ++c) {
+		const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		const bool done = edits.redo(track);
+		redoing += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		if (!done)
+			break;
+		wrong += pointsHash(track.points) != hashes[c];
+	}
+	const bool back = pointsHash(track.points) == hashes.back() && !edits.canRedo();
+
+	printf("track %s: %d commands undone in %.3f ms and redone in %.3f ms (%.1f us each), history of %.1f KB (the track is %.1f KB)\n",
+			 file, count, 1e3 * undoing, 1e3 * redoing, count ? 1e6 * (undoing + redoing) / (2 * count) : 0.0,
+			 edits.size() * sizeof(PointEdit) / 1024.0, track.points.size() * sizeof(ControlPoint) / 1024.0);
+	printf("%d steps didn't match, %s\n", wrong, wrong == 0 && all && back ? "ok" : "FAILED");
+	return wrong == 0 && all && back ? 0 : 1;
+}
+
+//****************************************************************************
+//
+// * the command file is run on the track as one batch, then again through
+//   the undo history, which has to take it back and make it again exactly
+//============================================================================
+static int edit(int argc, char** argv)
+//============================================================================
+{
+	const char* file = 0;
+	const char* commands = 0;
+	const char* out = 0;
+	int spline = Spline_Cardinal;
+
+	for (int i = 0; i < argc; ++i) {
+		const char* a = argv[i];
+		const bool more = i + 1 < argc;
+		if (!strcmp(a, "--out") && more)
+			out = argv[++i];
+		else if (!strcmp(a, "--spline") && more) {
+			spline = parseSpline(argv[++i]);
+			if (spline == Spline_None) {
+				fprintf(stderr, "Unknown spline type %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (a[0] == '-' || commands) {
+			usage();
+			return 1;
+		}
+		else if (file)
+			commands = a;
+		else
+			file = a;
+	}
+	if (!commands) {
+		usage();
+		return 1;
+	}
+
+	CTrack track;
+	const char* why = 0;
+	if (!track.readPoints(file, &why)) {
+		fprintf(stderr, "Can't read %s %s\n", file, why ? why : "");
+		return 1;
+	}
+
+	TrackEdit edits;
+	int line = 0;
+	if (!edits.read(commands, &why, &line)) {
+		fprintf(stderr, "%s:%d: %s\n", commands, line, why);
+		return 1;
+	}
+
+	const CTrack original = track;
+	const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	const bool applied = edits.apply(track, spline, 0, &why, &line);
+	const double took = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	if (!applied) {
+		fprintf(stderr, "%s:%d: %s\n", commands, line, why);
+		return 1;
+	}
+
+	// the same through the history
+	CTrack undone = original;
+	EditHistory history;
+	edits.apply(undone, spline, &history);
+	const bool same = samePoints(undone.points, track.points);
+	history.undo(undone);
+	const bool back = samePoints(undone.points, original.points);
+	history.redo(undone);
+	const bool again = samePoints(undone.points, track.points);
+
+	printf("track %s: %d commands, %d points to %d in %.3f ms, %ld edits in the history\n",
+			 file, edits.size(), (int) original.points.size(), (int) track.points.size(),
+			 1e3 * took, history.size());
+	printf("through the history %s, undo %s, redo %s\n", same ? "the same" : "DIFFERENT",
+			 back ? "ok" : "FAILED", again ? "ok" : "FAILED");
+
+	if (out && !track.writePoints(out, &why)) {
+		fprintf(stderr, "Can't write %s %s\n", out, why ? why : "");
+		return 1;
+	}
+	return same && back && again ? 0 : 1;
+}
+
+//****************************************************************************
+//
+// * the work of a new track, with as many threads as we are told
+//============================================================================
+static int rebuild(int argc, char** argv)
+//============================================================================
+{
+	const char* file = 0;
+	int spline = Spline_Cardinal;
+	int threads = 0;
+	int repeat = 5;
+
+	for (int i = 0; i < argc; ++i) {
+		const char* a = argv[i];
+		const bool more = i + 1 < argc;
+		if (!strcmp(a, "--threads") && more)
+			threads = atoi(argv[++i]);
+		else if (!strcmp(a, "--repeat") && more)
+			repeat = atoi(argv[++i]);
+		else if (!strcmp(a, "--spline") && more) {
+			spline = parseSpline(argv[++i]);
+			if (spline == Spline_None) {
+				fprintf(stderr, "Unknown spline type %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (a[0] == '-' || file) {
+			usage();
+			return 1;
+		}
+		else
+			file = a;
+	}
+
+	CTrack track;
+	const char* why = 0;
+	if (!file || !track.readPoints(file, &why) || track.points.size() < 4) {
+		fprintf(stderr, "Can't read %s %s\n", file ? file : "", why ? why : "");
+		return 1;
+	}
+	if (threads > 0)
+		JobPool::configure(threads - 1);
+
+	double measure = FLT_MAX, sweep = FLT_MAX;
+	ArcLengthTable table;
+	ClearanceChecker checker;
+	for (int r = 0; r < repeat; ++r)
+	{
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		table.build(track.points, spline);
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		measure = std::min(measure, std::chrono::duration<double>(end - begin).count());
+
+		checker.clear();
+		begin = std::chrono::steady_clock::now();
+		checker.update(track, spline);
+		end = std::chrono::steady_clock::now();
+		sweep = std::min(sweep, std::chrono::duration<double>(end - begin).count());
+	}
+
+	printf("track %s: %d points, %d threads, length %.1f, measured in %.2f ms, "
+			 "swept for clearance in %.2f ms (best of %d)\n",
+			 file, (int) track.points.size(), JobPool::shared().threads(), table.length(),
+			 1e3 * measure, 1e3 * sweep, repeat);
+	return 0;
+}
+
+// what goes through the channel in the stress test: the poses between two
+// copies of the tick they are from, and the sum of all of their floats
+struct StampedPoses {
+	StampedPoses() : first(0), sum(0), last(0) {}
+
+	long			first;
+	TrainPoses	poses;
+	double		sum;
+	long			last;
+};
+
+//****************************************************************************
+//
+// *
+//============================================================================
+static double poseSum(const TrainPoses& poses)
+//============================================================================
+{
+	double sum = poses.eye.x + poses.eye.y + poses.eye.z;
+	for (size_t k = 0; k < poses.frames.size(); ++k)
+		sum += poses.frames[k];
+	return sum;
+}
+
+//****************************************************************************
+//
+// * the p-th percentile of some timings (sorts them)
+//============================================================================
+static double percentile(std::vector<double>& took, const double p)
+//============================================================================
+{
+	if (took.empty())
+		return 0;
+	std::sort(took.begin(), took.end());
+	return took[std::min(took.size() - 1, (size_t) (p / 100 * took.size()))];
+}
+
+//****************************************************************************
+//
+// * the sim ticks on its own thread at a fixed rate and publishes every
+//   tick, this thread reads the newest one like the window would. a read
+//   that got parts of two ticks would have stamps or a sum that don't match
+//============================================================================
+static int channel(int argc, char** argv)
+//============================================================================
+{
+	const char* file = 0;
+	int spline = Spline_Cardinal;
+	double rate = 1000;
+	double seconds = 5;
+	double fps = 0;
+	int trains = 3;
+	TrainSim sim;
+	sim.setCars(0, 10);
+
+	for (int i = 0; i < argc; ++i) {
+		const char* a = argv[i];
+		const bool more = i + 1 < argc;
+		if (!strcmp(a, "--rate") && more)
+			rate = atof(argv[++i]);
+		else if (!strcmp(a, "--seconds") && more)
+			seconds = atof(argv[++i]);
+		else if (!strcmp(a, "--fps") && more)
+			fps = atof(argv[++i]);
+		else if (!strcmp(a, "--trains") && more)
+			trains = atoi(argv[++i]);
+		else if (!strcmp(a, "--cars") && more)
+			sim.setCars(0, atoi(argv[++i]));
+		else if (!strcmp(a, "--spline") && more) {
+			spline = parseSpline(argv[++i]);
+			if (spline == Spline_None) {
+				fprintf(stderr, "Unknown spline type %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (a[0] == '-' || file) {
+			usage();
+			return 1;
+		}
+		else
+			file = a;
+	}
+
+	CTrack track;
+	const char* why = 0;
+	if (!file || !track.readPoints(file, &why) || track.points.size() < 4) {
+		fprintf(stderr, "Can't read %s %s\n", file ? file : "", why ? why : "");
+		return 1;
+	}
+	if (rate <= 0) {
+		usage();
+		return 1;
+	}
+
+	for (int t = 1; t < trains; ++t)
+		sim.addTrain(0, sim.cars[0], sim.speed[0] * (0.5f + (t * 37 % 100) / 100.0f));
+	sim.rewind(track);
+
+	const long ticks = (long) (rate * seconds);
+	const std::chrono::nanoseconds period((long long) (1e9 / rate));
+
+	TripleBuffer<StampedPoses> poses;
+	std::atomic<bool> done(false);
+	std::vector<double> publishing;		// ns, per tick
+	long late = 0;
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	std::thread producer([&]() {
+		std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+		for (long tick = 1; tick <= ticks; ++tick)
+		{
+			sim.advance(track, spline);
+
+			StampedPoses& p = poses.back();
+			p.first = tick;
+			sim.pose(track, spline, p.poses);
+			p.sum = poseSum(p.poses);
+			p.last = tick;
+
+			std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+			poses.publish();
+			std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+			publishing.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count());
+
+			next += period;
+			if (t1 > next)
+				++late;
+			else
+				std::this_thread::sleep_until(next);
+		}
+		done = true;
+	});
+
+	long reads = 0, seen = 0, torn = 0, backwards = 0, lastTick = 0;
+	std::vector<double> reading;		// ns, per read that got a new tick
+	double readWorst = 0, readTotal = 0;
+	const std::chrono::nanoseconds frame(fps > 0 ? (long long) (1e9 / fps) : 0);
+	std::chrono::steady_clock::time_point nextFrame = std::chrono::steady_clock::now();
+	for (;;)
+	{
+		const bool last = done.load();
+
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		const StampedPoses& p = poses.read();
+		std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+		const double took = std::chrono::duration<double, std::nano>(t1 - t0).count();
+		readWorst = std::max(readWorst, took);
+		readTotal += took;
+		++reads;
+
+		if (p.first != lastTick)
+		{
+			if (p.first != p.last || poseSum(p.poses) != p.sum)
+				++torn;
+			if (p.first < lastTick)
+				++backwards;
+			lastTick = p.first;
+			reading.push_back(took);
+			++seen;
+		}
+
+		if (last)
+			break;
+		if (fps > 0) {
+			nextFrame += frame;
+			std::this_thread::sleep_until(nextFrame);
+		}
+		else
+			std::this_thread::yield();
+	}
+	producer.join();
+	const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	printf("track %s: %d trains, %d cars, %ld ticks in %.2f s (%.0f ticks / sec, %ld late)\n",
+			 file, sim.trains(), (int) sim.carU.size(), ticks, wall, ticks / wall, late);
+	printf("publish: %.0f ns median, %.0f ns p99, %.0f ns at most\n",
+			 percentile(publishing, 50), percentile(publishing, 99), percentile(publishing, 100));
+	printf("read: %ld reads, %.0f ns on average, %.0f ns at most, %.0f ns p99 for a new tick\n",
+			 reads, reads ? readTotal / reads : 0.0, readWorst, percentile(reading, 99));
+	printf("%ld of %ld ticks seen, the last one %s, %ld torn, %ld out of order\n",
+			 seen, ticks, lastTick == ticks ? "too" : "NOT", torn, backwards);
+	return torn == 0 && backwards == 0 && lastTick == ticks ? 0 : 1;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+int main(int argc, char** argv)
+//============================================================================
+{
+	if (argc < 2) {
+		usage();
+		return 1;
+	}
+
+	if (!strcmp(argv[1], "analyze"))
+		return analyze(argc - 2, argv + 2);
+	if (!strcmp(argv[1], "energy"))
+		return energy(argc - 2, argv + 2);
+	if (!strcmp(argv[1], "bench"))
+		return bench(argc - 2, argv + 2);
+	if (!strcmp(argv[1], "drift"))
+		return drift(argc - 2, argv + 2);
+	if (!strcmp(argv[1], "run"))
+		return run(argc - 2, argv + 2);
+	if (!strcmp(argv[1], "record"))
+		return record(argc - 2, argv + 2);
+	if (!strcmp(argv[1], "replay"))
+		return replay(argc - 2, argv + 2);
+	if (!strcmp(argv[1], "clearance"))
+		return clearance(argc - 2, argv + 2);
+	if (!strcmp(argv[1], "history"))
+		return history(argc - 2, argv + 2);
+	if (!strcmp(argv[1], "edit"))
+		return edit(argc - 2, argv + 2);
+	if (!strcmp(argv[1], "rebuild"))
+		return rebuild(argc - 2, argv + 2);
+	if (!strcmp(argv[1], "channel"))
+		return channel(argc - 2, argv + 2);
+
+	usage();
+	return 1;
+}
@@ -0,0 +1,109 @@
+/************************************************************************
+     File:        Spline.cpp
+
+     Comment:     Evaluating the track curve
+
+						The curve through the control points, independent of
+						any window, so the same code can be used by the
+						TrainView for drawing and by the headless tools.
+
+						See Spline.H for how the bases work.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <atomic>
+
+#include "Spline.H"
+
+constexpr float LinearBasis::M[4][4];
+constexpr float BSplineBasis::M[4][4];
+
+// points evaluated by getCurvesPoints, counted once per batch
+static std::atomic<long long> Curve_Evaluations(0);
+
+//****************************************************************************
+//
+// * the position, direction and up vector of the curve at t
+//============================================================================
+void getCurvesPoint(const std::vector<ControlPoint>& points, const int type, const double t,
+						  Pnt3f* pos, Pnt3f* dir, Pnt3f* up)
+//============================================================================
+{
+	getCurvesPoints(points, type, &t, 1, pos, dir, up);
+}
+
+//****************************************************************************
+//
+// * pick the basis once, then the whole batch runs with it
+//============================================================================
+void getCurvesPoints(const std::vector<ControlPoint>& points, const int type,
+							const double* t, const int count, Pnt3f* pos, Pnt3f* dir, Pnt3f* up)
+//============================================================================
+{
+	if (points.empty())
+		return;
+
+	Curve_Evaluations.fetch_add(count, std::memory_order_relaxed);
+	switch (type)
+	{
+		case Spline_Linear:
+			evalCurves<LinearBasis>(points, t, count, pos, dir, up);
+			break;
+		case Spline_Cardinal:
+			evalCurves<CatmullRomBasis>(points, t, count, pos, dir, up);
+			break;
+		case Spline_B_Spline:
+			evalCurves<BSplineBasis>(points, t, count, pos, dir, up);
+			break;
+	}
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+template <class B>
+static void evalDerivativesBatch(const std::vector<ControlPoint>& points, const double* t,
+											const int count, Pnt3f* d1, Pnt3f* d2)
+//============================================================================
+{
+	for (int i = 0; i < count; ++i)
+		evalDerivatives<B>(points, t[i], d1 + i, d2 + i);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void getCurvesDerivatives(const std::vector<ControlPoint>& points, const int type,
+								  const double* t, const int count, Pnt3f* d1, Pnt3f* d2)
+//============================================================================
+{
+	if (points.empty())
+		return;
+
+	switch (type)
+	{
+		case Spline_Linear:
+			evalDerivativesBatch<LinearBasis>(points, t, count, d1, d2);
+			break;
+		case Spline_Cardinal:
+			evalDerivativesBatch<CatmullRomBasis>(points, t, count, d1, d2);
+			break;
+		case Spline_B_Spline:
+			evalDerivativesBatch<BSplineBasis>(points, t, count, d1, d2);
+			break;
+	}
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+long long curveEvaluations()
+//============================================================================
+{
+	return Curve_Evaluations.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,263 @@
+/************************************************************************
+     File:        Telemetry.cpp
+
+     Comment:     What the riders go through, tick by tick
+
+						See Telemetry.H
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <math.h>
+#include <string.h>
+
+#include "Telemetry.H"
+#include "Spline.H"
+
+const char* Telemetry_Names[Telemetry_Columns] = {
+	"time", "distance",
+	"x", "y", "z",
+	"vx", "vy", "vz",
+	"ax", "ay", "az",
+	"vertical_g", "lateral_g", "longitudinal_g",
+	"curvature", "bank"
+};
+
+static const char Telemetry_Magic[8] = { 'R', 'I', 'D', 'E', 'T', 'E', 'L', '1' };
+
+static inline float dot(const Pnt3f& a, const Pnt3f& b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+Telemetry::
+Telemetry()
+	: samples(0), fp(0), binary(false), train(0), count(0),
+	  lastDistance(0), lastSpeed(0), first(true)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * whatever is still waiting can't be worked out without the track
+//============================================================================
+Telemetry::
+~Telemetry()
+//============================================================================
+{
+	if (fp)
+		fclose(fp);
+}
+
+//****************************************************************************
+//
+// * the buffers for a batch are all allocated here
+//============================================================================
+bool Telemetry::
+open(const char* filename, const bool bin, const int t, const char** why)
+//============================================================================
+{
+	if (fp)
+		fclose(fp);
+
+	fp = fopen(filename, bin ? "wb" : "w");
+	if (!fp) {
+		if (why) *why = "Can't open the file for writing";
+		return false;
+	}
+
+	binary = bin;
+	train = t;
+	samples = 0;
+	count = 0;
+	first = true;
+	lastSpeed = 0;
+
+	distance.resize(Telemetry_Batch);
+	speed.resize(Telemetry_Batch);
+	u.resize(Telemetry_Batch);
+	pos.resize(Telemetry_Batch);
+	up.resize(Telemetry_Batch);
+	d1.resize(Telemetry_Batch);
+	d2.resize(Telemetry_Batch);
+	columns.resize(Telemetry_Columns * Telemetry_Batch);
+
+	if (binary) {
+		const unsigned header[2] = { Telemetry_Columns, Tick_Rate };
+		fwrite(Telemetry_Magic, 1, sizeof(Telemetry_Magic), fp);
+		fwrite(header, sizeof(unsigned), 2, fp);
+		for (int c = 0; c < Telemetry_Columns; ++c)
+			fwrite(Telemetry_Names[c], 1, strlen(Telemetry_Names[c]) + 1, fp);
+	}
+	else {
+		for (int c = 0; c < Telemetry_Columns; ++c)
+			fprintf(fp, c ? ",%s" : "%s", Telemetry_Names[c]);
+		fprintf(fp, "\n");
+	}
+	return true;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void Telemetry::
+close(const TrainSim& sim, const CTrack& track, const int spline)
+//============================================================================
+{
+	if (!fp)
+		return;
+
+	flush(sim, track, spline);
+	fclose(fp);
+	fp = 0;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+bool Telemetry::
+recording() const
+//============================================================================
+{
+	return fp != 0;
+}
+
+//****************************************************************************
+//
+// * the speed is how far the train got in the tick, with physics or
+//   without - after an edit the distance jumps, so it keeps the speed.
+//   Samples still waiting when the track changes are worked out on the
+//   new one, so flush them first if that matters
+//============================================================================
+void Telemetry::
+tick(const TrainSim& sim, const CTrack& track, const int spline)
+//============================================================================
+{
+	if (!fp || train >= sim.trains())
+		return;
+
+	const double d = sim.distance[train];
+	const double total = sim.table.length();
+	float v = count > 0 ? speed[count - 1] : lastSpeed;
+	if (first)
+	{
+		// nothing to measure yet, the physics knows
+		if (sim.physics)
+			v = sim.velocity[train];
+		lastSpeed = v;
+	}
+	else if (!sim.edited)
+	{
+		double step = d - lastDistance;
+		if (step > total / 2) step -= total;
+		if (step < -total / 2) step += total;
+		v = (float) (step * Tick_Rate);
+	}
+	first = false;
+	lastDistance = d;
+
+	distance[count] = d;
+	speed[count] = v;
+	if (++count == Telemetry_Batch)
+		flush(sim, track, spline);
+}
+
+//****************************************************************************
+//
+// * one pass per step over the batch: parameters, curve, then the frame
+//   and the forces of every sample
+//============================================================================
+void Telemetry::
+flush(const TrainSim& sim, const CTrack& track, const int spline)
+//============================================================================
+{
+	const int n = count;
+	if (n == 0)
+		return;
+
+	for (int k = 0; k < n; ++k)
+		u[k] = sim.table.parameter(distance[k]);
+	getCurvesPoints(track.points, spline, &u[0], n, &pos[0], NULL, &up[0]);
+	getCurvesDerivatives(track.points, spline, &u[0], n, &d1[0], &d2[0]);
+
+	float* col[Telemetry_Columns];
+	for (int c = 0; c < Telemetry_Columns; ++c)
+		col[c] = &columns[c * n];
+
+	const float pi = 3.14159265f;
+	for (int k = 0; k < n; ++k)
+	{
+		const float v = speed[k];
+		const float a = (v - (k > 0 ? speed[k - 1] : lastSpeed)) * Tick_Rate;
+
+		// unit tangent, and the part of the second derivative across it is
+		// the curvature (times the normal) once it is over |d1|^2
+		const float rate2 = dot(d1[k], d1[k]);
+		const float rate = sqrt(rate2);
+		const Pnt3f T = rate > 0 ? d1[k] * (1 / rate) : Pnt3f(1, 0, 0);
+		const Pnt3f kn = rate2 > 0 ? (d2[k] + T * -dot(d2[k], T)) * (1 / rate2) : Pnt3f(0, 0, 0);
+
+		const Pnt3f vel = T * v;
+		const Pnt3f acc = T * a + kn * (v * v);
+		Pnt3f felt = acc;
+		felt.y += Gravity;
+
+		// the frame of the track, the way it is drawn
+		Pnt3f side = T * up[k];
+		side.normalize();
+		Pnt3f on = side * T;
+		on.normalize();
+
+		// bank is the roll from the same frame without any banking
+		Pnt3f flatSide = T * Pnt3f(0, 1, 0);
+		float bank = 0;
+		if (dot(flatSide, flatSide) > 1e-8f)
+		{
+			flatSide.normalize();
+			const Pnt3f flatUp = flatSide * T;
+			bank = atan2(dot(on, flatSide), dot(on, flatUp)) * 180 / pi;
+		}
+
+		col[Tel_Time][k] = (float) (samples + k) / Tick_Rate;
+		col[Tel_Distance][k] = (float) distance[k];
+		col[Tel_X][k] = pos[k].x;
+		col[Tel_Y][k] = pos[k].y;
+		col[Tel_Z][k] = pos[k].z;
+		col[Tel_VX][k] = vel.x;
+		col[Tel_VY][k] = vel.y;
+		col[Tel_VZ][k] = vel.z;
+		col[Tel_AX][k] = acc.x;
+		col[Tel_AY][k] = acc.y;
+		col[Tel_AZ][k] = acc.z;
+		col[Tel_Vertical_G][k] = dot(felt, on) / Gravity;
+		col[Tel_Lateral_G][k] = dot(felt, side) / Gravity;
+		col[Tel_Longitudinal_G][k] = dot(felt, T) / Gravity;
+		col[Tel_Curvature][k] = sqrt(dot(kn, kn));
+		col[Tel_Bank][k] = bank;
+	}
+
+	if (binary) {
+		const unsigned block = (unsigned) n;
+		fwrite(&block, sizeof(block), 1, fp);
+		fwrite(&columns[0], sizeof(float), Telemetry_Columns * n, fp);
+	}
+	else {
+		for (int k = 0; k < n; ++k) {
+			for (int c = 0; c < Telemetry_Columns; ++c)
+				fprintf(fp, c ? ",%g" : "%g", col[c][k]);
+			fprintf(fp, "\n");
+		}
+	}
+
+	lastSpeed = speed[n - 1];
+	samples += n;
+	count = 0;
+}
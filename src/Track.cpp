@@ -26,7 +26,7 @@
 
 #include "Track.H"
 
-#include <FL/fl_ask.h>
+#include <atomic>
 #include <cstdio>
 #include <cstdlib>
 
@@ -35,12 +35,26 @@
 // * Constructor
 //============================================================================
 CTrack::
-CTrack() : trainU(0)
+CTrack()
+	: revision(0)
 //============================================================================
 {
 	resetPoints();
 }
 
+//****************************************************************************
+//
+// * the revisions are counted over all tracks (the window and the tools
+//   on other threads)
+//============================================================================
+void CTrack::
+touch()
+//============================================================================
+{
+	static std::atomic<unsigned long> revisions(0);
+	revision = ++revisions;
+}
+
 //****************************************************************************
 //
 // * provide a default set of points
@@ -55,9 +69,7 @@ resetPoints()
 	points.push_back(ControlPoint(Pnt3f(0,5,50)));
 	points.push_back(ControlPoint(Pnt3f(-50,5,0)));
 	points.push_back(ControlPoint(Pnt3f(0,5,-50)));
-
-	// we had better put the train back at the start of the track...
-	trainU = 0.0;
+	touch();
 }
 
 //****************************************************************************
@@ -107,13 +119,14 @@ void breakString(char* str, std::vector<const char*>& words)
 //	  other lines: one line per control point
 //   either 3 (X,Y,Z) numbers on the line, or 6 numbers (X,Y,Z, orientation)
 //============================================================================
-void CTrack::
-readPoints(const char* filename)
+bool CTrack::
+readPoints(const char* filename, const char** why)
 //============================================================================
 {
+	const char* error = 0;
 	FILE* fp = fopen(filename,"r");
 	if (!fp) {
-		fl_alert("Can't Open File!\n");
+		error = "Can't Open File!\n";
 	} 
 	else {
 		char buf[512];
@@ -123,7 +136,7 @@ readPoints(const char* filename)
 		size_t npts = (size_t) atoi(buf);
 
 		if( (npts<4) || (npts>65535)) {
-			fl_alert("Illegal Number of Points Specified in File");
+			error = "Illegal Number of Points Specified in File";
 		} else {
 			points.clear();
 			// get lines until EOF or we have enough points
@@ -152,23 +165,29 @@ readPoints(const char* filename)
 				orient.normalize();
 				points.push_back(ControlPoint(pos,orient));
 			}
+			touch();
 		}
 		fclose(fp);
 	}
-	trainU = 0;
+
+	if (error && why)
+		*why = error;
+	return !error;
 }
 
 //****************************************************************************
 //
 // * write the control points to our simple format
 //============================================================================
-void CTrack::
-writePoints(const char* filename)
+bool CTrack::
+writePoints(const char* filename, const char** why)
 //============================================================================
 {
 	FILE* fp = fopen(filename,"w");
 	if (!fp) {
-		fl_alert("Can't open file for writing");
+		if (why)
+			*why = "Can't open file for writing";
+		return false;
 	} else {
 		fprintf(fp,"%d\n",points.size());
 		for(size_t i=0; i<points.size(); ++i)
@@ -177,4 +196,23 @@ writePoints(const char* filename)
 				points[i].orient.x, points[i].orient.y, points[i].orient.z);
 		fclose(fp);
 	}
+	return true;
+}
+
+//****************************************************************************
+//
+// * do two sets of control points describe the same track
+//============================================================================
+bool samePoints(const std::vector<ControlPoint>& a, const std::vector<ControlPoint>& b)
+//============================================================================
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); ++i)
+	{
+		if (a[i].pos.x != b[i].pos.x || a[i].pos.y != b[i].pos.y || a[i].pos.z != b[i].pos.z ||
+			 a[i].orient.x != b[i].orient.x || a[i].orient.y != b[i].orient.y || a[i].orient.z != b[i].orient.z)
+			return false;
+	}
+	return true;
 }
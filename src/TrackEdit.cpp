@@ -0,0 +1,495 @@
+/************************************************************************
+     File:        TrackEdit.cpp
+
+     Comment:     A batch of edits of the control points
+
+						See TrackEdit.H
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ArcLength.H"
+#include "Spline.H"
+#include "TrackEdit.H"
+
+// as many as a track file can have
+static const int Track_Edit_Max_Points = 65535;
+static const int Track_Edit_Min_Points = 4;
+
+//****************************************************************************
+//
+// * a whole word that is a number
+//============================================================================
+static bool number(const char* word, float& v)
+//============================================================================
+{
+	char* end;
+	v = (float) strtod(word, &end);
+	return end != word && *end == 0;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+static bool integer(const char* word, int& v)
+//============================================================================
+{
+	char* end;
+	v = (int) strtol(word, &end, 10);
+	return end != word && *end == 0;
+}
+
+//****************************************************************************
+//
+// * first and last of n points (negative ones from the end) into
+//   from <= to, false if they aren't points of it
+//============================================================================
+static bool range(const int n, const int first, const int last, int& from, int& to)
+//============================================================================
+{
+	from = first < 0 ? first + n : first;
+	to = last < 0 ? last + n : last;
+	return from >= 0 && from <= to && to < n;
+}
+
+//****************************************************************************
+//
+// * the middle (the average) of the positions of from to to
+//============================================================================
+static Pnt3f middle(const std::vector<ControlPoint>& points, const int from, const int to)
+//============================================================================
+{
+	double x = 0, y = 0, z = 0;
+	for (int i = from; i <= to; ++i) {
+		x += points[i].pos.x;
+		y += points[i].pos.y;
+		z += points[i].pos.z;
+	}
+	const double n = to - from + 1;
+	return Pnt3f((float) (x / n), (float) (y / n), (float) (z / n));
+}
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+TrackEdit::
+TrackEdit()
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrackEdit::
+add(const TrackOp& op)
+//============================================================================
+{
+	ops.push_back(op);
+	if (ops.back().line == 0)
+		ops.back().line = (int) ops.size();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrackEdit::
+insert(const int index, const ControlPoint& p)
+//============================================================================
+{
+	TrackOp op = TrackOp();
+	op.kind = TrackOp::Insert;
+	op.first = op.last = index;
+	op.v = p.pos;
+	op.orient = p.orient;
+	add(op);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrackEdit::
+erase(const int first, const int last)
+//============================================================================
+{
+	TrackOp op = TrackOp();
+	op.kind = TrackOp::Erase;
+	op.first = first;
+	op.last = last;
+	add(op);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrackEdit::
+move(const int first, const int last, const Pnt3f& by)
+//============================================================================
+{
+	TrackOp op = TrackOp();
+	op.kind = TrackOp::Move;
+	op.first = first;
+	op.last = last;
+	op.v = by;
+	add(op);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrackEdit::
+rotate(const int first, const int last, const float degrees)
+//============================================================================
+{
+	TrackOp op = TrackOp();
+	op.kind = TrackOp::Rotate;
+	op.first = first;
+	op.last = last;
+	op.amount = degrees;
+	add(op);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrackEdit::
+scale(const int first, const int last, const float factor)
+//============================================================================
+{
+	TrackOp op = TrackOp();
+	op.kind = TrackOp::Scale;
+	op.first = first;
+	op.last = last;
+	op.amount = factor;
+	add(op);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrackEdit::
+orient(const int first, const int last, const Pnt3f& orient)
+//============================================================================
+{
+	TrackOp op = TrackOp();
+	op.kind = TrackOp::Orient;
+	op.first = first;
+	op.last = last;
+	op.v = orient;
+	add(op);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrackEdit::
+resample(const int count)
+//============================================================================
+{
+	TrackOp op = TrackOp();
+	op.kind = TrackOp::Resample;
+	op.first = op.last = count;
+	add(op);
+}
+
+//****************************************************************************
+//
+// * only the words are checked here, whether the indices are points of
+//   the track is up to run
+//============================================================================
+bool TrackEdit::
+parse(char* line, const int lineNumber, const char** why)
+//============================================================================
+{
+	std::vector<const char*> words;
+	breakString(line, words);
+	if (words.empty())
+		return true;
+
+	const char* cmd = words[0];
+	const int n = (int) words.size() - 1;
+	float f[6] = { 0 };
+	int a = 0, b = 0;
+	bool ok = false;
+
+	TrackOp op = TrackOp();
+	op.line = lineNumber;
+	if (!strcmp(cmd, "insert") && (n == 4 || n == 7)) {
+		ok = integer(words[1], a);
+		for (int k = 0; k < n - 1; ++k)
+			ok = ok && number(words[k + 2], f[k]);
+		op.kind = TrackOp::Insert;
+		op.first = op.last = a;
+		op.v = Pnt3f(f[0], f[1], f[2]);
+		op.orient = n == 7 ? Pnt3f(f[3], f[4], f[5]) : Pnt3f(0, 1, 0);
+	}
+	else if (!strcmp(cmd, "delete") && (n == 1 || n == 2)) {
+		ok = integer(words[1], a) && integer(words[n], b);
+		op.kind = TrackOp::Erase;
+		op.first = a;
+		op.last = b;
+	}
+	else if ((!strcmp(cmd, "move") || !strcmp(cmd, "orient")) && n == 5) {
+		ok = integer(words[1], a) && integer(words[2], b) &&
+			  number(words[3], f[0]) && number(words[4], f[1]) && number(words[5], f[2]);
+		op.kind = !strcmp(cmd, "move") ? TrackOp::Move : TrackOp::Orient;
+		op.first = a;
+		op.last = b;
+		op.v = Pnt3f(f[0], f[1], f[2]);
+	}
+	else if ((!strcmp(cmd, "rotate") || !strcmp(cmd, "scale")) && n == 3) {
+		ok = integer(words[1], a) && integer(words[2], b) && number(words[3], f[0]);
+		op.kind = !strcmp(cmd, "rotate") ? TrackOp::Rotate : TrackOp::Scale;
+		op.first = a;
+		op.last = b;
+		op.amount = f[0];
+	}
+	else if (!strcmp(cmd, "resample") && n == 1) {
+		ok = integer(words[1], a);
+		op.kind = TrackOp::Resample;
+		op.first = op.last = a;
+	}
+	else {
+		if (why) *why = "Unknown command, or the wrong number of words for it";
+		return false;
+	}
+
+	if (!ok) {
+		if (why) *why = "Not a number";
+		return false;
+	}
+	add(op);
+	return true;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+bool TrackEdit::
+read(const char* filename, const char** why, int* line)
+//============================================================================
+{
+	FILE* fp = fopen(filename, "r");
+	if (!fp) {
+		if (why) *why = "Can't Open File!";
+		if (line) *line = 0;
+		return false;
+	}
+
+	char buf[512];
+	int lineNumber = 0;
+	bool ok = true;
+	while (ok && fgets(buf, sizeof(buf), fp)) {
+		++lineNumber;
+		// a line that didn't fit would go on as a line of its own - no
+		// newline is only all right at the end of the file
+		const size_t length = strlen(buf);
+		if (length > 0 && buf[length - 1] != '\n' && getc(fp) != EOF) {
+			if (why) *why = "Line too long";
+			ok = false;
+		}
+		else
+			ok = parse(buf, lineNumber, why);
+	}
+	fclose(fp);
+
+	if (!ok && line)
+		*line = lineNumber;
+	return ok;
+}
+
+//****************************************************************************
+//
+// * the commands one after the other on a copy
+//============================================================================
+bool TrackEdit::
+run(const std::vector<ControlPoint>& points, const int spline,
+	 std::vector<ControlPoint>& result, const char** why, int* line) const
+//============================================================================
+{
+	std::vector<ControlPoint> work(points);
+	const char* error = 0;
+
+	size_t k = 0;
+	for (; k < ops.size() && !error; ++k)
+	{
+		const TrackOp& op = ops[k];
+		const int n = (int) work.size();
+		int from = 0, to = 0;
+
+		switch (op.kind)
+		{
+			case TrackOp::Insert: {
+				from = op.first < 0 ? op.first + n + 1 : op.first;
+				if (from < 0 || from > n)
+					error = "No such point";
+				else if (op.orient.x == 0 && op.orient.y == 0 && op.orient.z == 0)
+					error = "The orientation can't be 0";
+				else if (n + 1 > Track_Edit_Max_Points)
+					error = "Too many points";
+				else {
+					Pnt3f orient = op.orient;
+					orient.normalize();
+					work.insert(work.begin() + from, ControlPoint(op.v, orient));
+				}
+				break;
+			}
+
+			case TrackOp::Erase:
+				if (!range(n, op.first, op.last, from, to))
+					error = "No such points";
+				else if (n - (to - from + 1) < Track_Edit_Min_Points)
+					error = "The track needs at least 4 points";
+				else
+					work.erase(work.begin() + from, work.begin() + to + 1);
+				break;
+
+			case TrackOp::Move:
+				if (!range(n, op.first, op.last, from, to))
+					error = "No such points";
+				else
+					for (int i = from; i <= to; ++i)
+						work[i].pos = work[i].pos + op.v;
+				break;
+
+			case TrackOp::Rotate:
+				if (!range(n, op.first, op.last, from, to))
+					error = "No such points";
+				else {
+					const Pnt3f c = middle(work, from, to);
+					const float a = (float) (op.amount * M_PI / 180.0);
+					const float co = cos(a), si = sin(a);
+					for (int i = from; i <= to; ++i) {
+						const float x = work[i].pos.x - c.x, z = work[i].pos.z - c.z;
+						work[i].pos.x = c.x + co * x + si * z;
+						work[i].pos.z = c.z - si * x + co * z;
+						const Pnt3f o = work[i].orient;
+						work[i].orient.x = co * o.x + si * o.z;
+						work[i].orient.z = -si * o.x + co * o.z;
+					}
+				}
+				break;
+
+			case TrackOp::Scale:
+				if (!range(n, op.first, op.last, from, to))
+					error = "No such points";
+				else if (op.amount == 0)
+					error = "Can't scale by 0";
+				else {
+					const Pnt3f c = middle(work, from, to);
+					for (int i = from; i <= to; ++i)
+						work[i].pos = c + (work[i].pos + c * -1.0f) * op.amount;
+				}
+				break;
+
+			case TrackOp::Orient:
+				if (!range(n, op.first, op.last, from, to))
+					error = "No such points";
+				else if (op.v.x == 0 && op.v.y == 0 && op.v.z == 0)
+					error = "The orientation can't be 0";
+				else {
+					Pnt3f orient = op.v;
+					orient.normalize();
+					for (int i = from; i <= to; ++i)
+						work[i].orient = orient;
+				}
+				break;
+
+			case TrackOp::Resample: {
+				const int count = op.first;
+				if (count < Track_Edit_Min_Points || count > Track_Edit_Max_Points)
+					error = "Resample to 4 to 65535 points";
+				else if (spline == Spline_None)
+					error = "Resample needs a spline type";
+				else {
+					ArcLengthTable table;
+					table.build(work, spline);
+					const double step = table.length() / count;
+
+					std::vector<double> t(count);
+					for (int i = 0; i < count; ++i)
+						t[i] = table.parameter(i * step);
+					std::vector<Pnt3f> pos(count), up(count);
+					::getCurvesPoints(work, spline, &t[0], count, &pos[0], NULL, &up[0]);
+
+					work.resize(count);
+					for (int i = 0; i < count; ++i)
+						work[i] = ControlPoint(pos[i], up[i]);
+				}
+				break;
+			}
+		}
+	}
+
+	if (error) {
+		if (why) *why = error;
+		if (line) *line = ops[k - 1].line;
+		return false;
+	}
+	result.swap(work);
+	return true;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+bool TrackEdit::
+apply(CTrack& track, const int spline, EditHistory* history,
+		const char** why, int* line) const
+//============================================================================
+{
+	std::vector<ControlPoint> result;
+	if (!run(track.points, spline, result, why, line))
+		return false;
+
+	if (history) {
+		history->commit();
+		history->replace(track, result);
+		history->commit();
+	}
+	else {
+		track.points.swap(result);
+		track.touch();
+	}
+	return true;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+int TrackEdit::
+size() const
+//============================================================================
+{
+	return (int) ops.size();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrackEdit::
+clear()
+//============================================================================
+{
+	ops.clear();
+}
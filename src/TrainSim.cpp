@@ -0,0 +1,561 @@
+/************************************************************************
+     File:        TrainSim.cpp
+
+     Comment:     The train simulation
+
+						Moves the trains along the track and places their
+						cars. This used to live in TrainWindow::advanceTrain
+						and TrainView::drawTrain, it is pulled out here so that
+						it doesn't need any widgets.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <math.h>
+#include <algorithm>
+
+#include "TrainSim.H"
+#include "Spline.H"
+
+//****************************************************************************
+//
+// * Constructor - one train with the same defaults as the widgets
+//============================================================================
+TrainSim::
+TrainSim()
+	: physics(true), arcLength(true), braking(false), headway(Train_Gap),
+	  friction(Friction), drag(Drag), holdTable(false), rebuilt(false), edited(false), settle(true),
+	  wasRebuilt(false), wasEdited(false)
+//============================================================================
+{
+	addTrain(0);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+int TrainSim::
+addTrain(const double u, const int n, const float v, const float w)
+//============================================================================
+{
+	speed.push_back(v);
+	weight.push_back(w);
+	cars.push_back(n < 1 ? 1 : n > Max_Cars ? Max_Cars : n);
+	head.push_back(u);
+	distance.push_back(0);
+	written.push_back(HUGE_VAL);		// not where it is, so it gets synced
+	firstCar.push_back(0);
+	placed.push_back(0);
+	velocity.push_back(0);
+	energy.push_back(0);
+	physics_effected_speed.push_back(0);
+	origional_speed.push_back(0);
+	braked.push_back(0);
+
+	settle = true;
+	wasEdited = true;
+	layoutCars();
+	return trains() - 1;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrainSim::
+removeTrain()
+//============================================================================
+{
+	if (trains() <= 1)
+		return;
+
+	speed.pop_back();
+	weight.pop_back();
+	cars.pop_back();
+	head.pop_back();
+	distance.pop_back();
+	written.pop_back();
+	firstCar.pop_back();
+	placed.pop_back();
+	velocity.pop_back();
+	energy.pop_back();
+	physics_effected_speed.pop_back();
+	origional_speed.pop_back();
+	braked.pop_back();
+
+	wasEdited = true;
+	layoutCars();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+int TrainSim::
+trains() const
+//============================================================================
+{
+	return (int) head.size();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrainSim::
+setCars(const int train, const int n)
+//============================================================================
+{
+	cars[train] = n < 1 ? 1 : n > Max_Cars ? Max_Cars : n;
+	settle = true;
+	wasEdited = true;
+	layoutCars();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrainSim::
+layoutCars()
+//============================================================================
+{
+	size_t total = 0;
+	for (int t = 0; t < trains(); ++t) {
+		firstCar[t] = (int) total;
+		total += placed[t];
+	}
+	carU.resize(total, 0);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrainSim::
+rewind(const CTrack& track)
+//============================================================================
+{
+	const int n = (int) track.points.size();
+	for (int t = 0; t < trains(); ++t) {
+		head[t] = (double) n * t / trains();
+		velocity[t] = 0;
+	}
+	settle = true;
+}
+
+//****************************************************************************
+//
+// * a new table measures a different track, the parameter of the head is
+//   what still means the same place on it. a held table is only measured
+//   again if it doesn't have the segments of the track
+//============================================================================
+bool TrainSim::
+sync(const CTrack& track, const int spline)
+//============================================================================
+{
+	const bool held = holdTable && table.firstKnot.size() == track.points.size() + 1;
+	const bool changed = !held && table.update(track, spline);
+	if (changed)
+		wasRebuilt = wasEdited = true;
+
+	for (int t = 0; t < trains(); ++t)
+	{
+		if (changed || head[t] != written[t])
+		{
+			distance[t] = table.distance(head[t]);
+			written[t] = head[t];
+			wasEdited = true;
+		}
+	}
+	return changed;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrainSim::
+moveTo(const int t, const double d)
+//============================================================================
+{
+	const double total = table.length();
+	double x = total > 0 ? fmod(d, total) : 0;
+	if (x < 0)
+		x += total;
+
+	distance[t] = x;
+	head[t] = written[t] = table.parameter(x);
+}
+
+//****************************************************************************
+//
+// * the cars are a fixed distance apart, so each one is a single lookup in
+//   the arc length table - the head car is at the head of the train
+//============================================================================
+void TrainSim::
+placeCars(const CTrack& track, const int spline)
+//============================================================================
+{
+	sync(track, spline);
+	layoutTrains();
+}
+
+//****************************************************************************
+//
+// * the curve at every car in one batch, and the frame of each car: x is
+//   across the track, y is up and z is along it
+//============================================================================
+void TrainSim::
+pose(const CTrack& track, const int spline, TrainPoses& poses)
+//============================================================================
+{
+	Pnt3f cross, on;
+
+	placeCars(track, spline);
+
+	carPos.resize(carU.size());
+	carDir.resize(carU.size());
+	carUp.resize(carU.size());
+	if (!carU.empty())
+		::getCurvesPoints(track.points, spline, &carU[0], (int) carU.size(),
+								&carPos[0], &carDir[0], &carUp[0]);
+
+	poses.frames.clear();
+	for (int t = 0; t < trains(); ++t)
+	{
+		for (int k = 0; k < placed[t]; ++k)
+		{
+			const Pnt3f& pos = carPos[firstCar[t] + k];
+			const Pnt3f& dir = carDir[firstCar[t] + k];
+			const Pnt3f& up = carUp[firstCar[t] + k];
+
+			cross = dir * up;
+			cross.normalize();
+
+			on = cross * dir;
+			on.normalize();
+
+			const float m[16] = {
+				cross.x, cross.y, cross.z, 0,
+				on.x,    on.y,    on.z,    0,
+				dir.x,   dir.y,   dir.z,   0,
+				pos.x,   pos.y,   pos.z,   1
+			};
+			poses.frames.insert(poses.frames.end(), m, m + 16);
+		}
+	}
+
+	::getCurvesPoint(track.points, spline, head[0], &poses.eye, &poses.look, &poses.up);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrainSim::
+layoutTrains()
+//============================================================================
+{
+	// as many cars as there is room for on the track
+	const float pitch = Train_Length + Train_Gap;
+	int room = (int) (table.length() / pitch);
+	if (room < 1)
+		room = 1;
+
+	for (int t = 0; t < trains(); ++t)
+		placed[t] = cars[t] < room ? cars[t] : room;
+	layoutCars();
+
+	for (int t = 0; t < trains(); ++t)
+	{
+		const double d = distance[t];
+		double* u = &carU[firstCar[t]];
+		for (int k = 0; k < placed[t]; ++k)
+			u[k] = table.parameter(d - k * pitch);
+	}
+}
+
+//****************************************************************************
+//
+// * sort the trains by where their backs are, then each one only needs to
+//   be compared with the ones after it around the loop until one starts
+//   far enough ahead - the gaps only grow from there. usually that is the
+//   next one, a long train can reach past more than one and gets an event
+//   (and waits) for every one it reaches
+//============================================================================
+void TrainSim::
+checkSpacing(const float dir)
+//============================================================================
+{
+	const int m = trains();
+	const double total = table.length();
+
+	events.clear();
+	braked.assign(m, 0);
+	if (m < 2 || total <= 0)
+		return;
+
+	order.resize(m);
+	rear.resize(m);
+	span.resize(m);
+	for (int t = 0; t < m; ++t)
+	{
+		const double front = distance[t];
+		const float d = placed[t] > 1 ? (placed[t] - 1) * (Train_Length + Train_Gap) : 0;
+
+		span[t] = d + Train_Length;
+		rear[t] = fmod(front - d - Train_Length / 2 + 2 * total, total);
+		order[t] = t;
+	}
+
+	const std::vector<double>& r = rear;
+	std::sort(order.begin(), order.end(), [&r](int a, int b) { return r[a] < r[b]; });
+
+	for (int k = 0; k < m; ++k)
+	{
+		const int a = order[k];
+		for (int j = 1; j < m; ++j)
+		{
+			const int b = order[(k + j) % m];
+
+			float gap = (float) (rear[b] - (rear[a] + span[a]));
+			if (k + j >= m)
+				gap += total;
+			if (gap >= headway)
+				break;
+
+			SpacingEvent e;
+			// going backwards, the train in front is the one behind
+			e.follower = dir < 0 ? b : a;
+			e.leader = dir < 0 ? a : b;
+			e.gap = gap;
+			e.collision = gap < 0;
+			events.push_back(e);
+			braked[e.follower] = 1;
+		}
+	}
+
+	// if the trains are packed all the way around nobody could ever move,
+	// let the one with the most room go - the room of a train is its
+	// smallest gap
+	if (std::count(braked.begin(), braked.end(), 1) == m)
+	{
+		int most = -1;
+		float mostRoom = 0;
+		for (int t = 0; t < m; ++t)
+		{
+			float room = headway;
+			for (size_t i = 0; i < events.size(); ++i)
+				if (events[i].follower == t && events[i].gap < room)
+					room = events[i].gap;
+			if (most < 0 || room > mostRoom) {
+				most = t;
+				mostRoom = room;
+			}
+		}
+		braked[most] = 0;
+	}
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+float TrainSim::
+carHeight(const int t, const double d) const
+//============================================================================
+{
+	const float pitch = Train_Length + Train_Gap;
+	float h = 0;
+	const int m = placed[t] > 0 ? placed[t] : 1;
+	for (int k = 0; k < m; ++k)
+		h += table.height(d - k * pitch);
+	return h / m;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+float TrainSim::
+carSlope(const int t, const double d) const
+//============================================================================
+{
+	const float pitch = Train_Length + Train_Gap;
+	float a = 0;
+	const int m = placed[t] > 0 ? placed[t] : 1;
+	for (int k = 0; k < m; ++k)
+		a += table.slope(d - k * pitch);
+	return a / m;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+float TrainSim::
+measureEnergy(const int t) const
+//============================================================================
+{
+	return 0.5f * velocity[t] * velocity[t] + Gravity * carHeight(t, distance[t]);
+}
+
+//****************************************************************************
+//
+// * after a tick the energies are measured only if physics is off (see
+//   advance), so that is all there is to settle
+//============================================================================
+void TrainSim::
+resume(const CTrack& track, const int spline)
+//============================================================================
+{
+	table.update(track, spline);
+	for (int t = 0; t < trains(); ++t)
+		written[t] = head[t];
+	settle = !physics;
+	wasRebuilt = wasEdited = false;
+	layoutTrains();
+}
+
+//****************************************************************************
+//
+// * the speed comes from the energy, not the other way around: move along
+//   the way gravity and the current speed take us, then whatever energy
+//   isn't height (or lost to friction and drag on the way) is speed.
+//   That way the energy can't creep up or down over many ticks.
+//============================================================================
+void TrainSim::
+roll(const int t, const float dir)
+//============================================================================
+{
+	const float dt = 1.0f / Tick_Rate;
+	double d = distance[t];
+	float v = velocity[t];
+
+	// the drive keeps the train going at least at the speed of the slider,
+	// in the direction we are running
+	const float drive = speed[t] * Drive_Speed;
+	if (drive > 0 && v * dir < drive)
+	{
+		v = dir * drive;
+		energy[t] = 0.5f * v * v + Gravity * carHeight(t, d);
+	}
+
+	const float a = -Gravity * carSlope(t, d);
+	const float ds = v * dt + 0.5f * a * dt * dt;
+	const float loss = (friction * Gravity + drag * v * v) * fabs(ds);
+	const float e = energy[t] - loss;
+
+	const float kinetic = e - Gravity * carHeight(t, d + ds);
+	if (kinetic >= 0)
+	{
+		d += ds;
+		v = (ds < 0 ? -1 : 1) * sqrt(2 * kinetic);
+	}
+	else
+	{
+		// it can't get that far: find where it runs out of speed, it stops
+		// there and rolls back from there next tick
+		float lo = 0, hi = ds;
+		for (int i = 0; i < 16; ++i)
+		{
+			const float mid = (lo + hi) / 2;
+			if (e - Gravity * carHeight(t, d + mid) >= 0)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		d += lo;
+		v = 0;
+	}
+
+	energy[t] = e;
+	velocity[t] = v;
+	moveTo(t, d);
+}
+
+//****************************************************************************
+//
+// * This will get called (approximately) Tick_Rate times per second
+//   if the trains are running - all of the trains are moved in one pass
+//============================================================================
+void TrainSim::
+advance(const CTrack& track, const int spline, const float dir)
+//============================================================================
+{
+	const int n = (int) track.points.size();
+
+	// comparing the points is the expensive part of checking the table,
+	// do it once
+	if (sync(track, spline))
+		settle = true;
+	layoutTrains();
+
+	rebuilt = wasRebuilt;
+	edited = wasEdited;
+	wasRebuilt = wasEdited = false;
+	checkSpacing(dir);
+
+	if (physics && settle)
+	{
+		for (int t = 0; t < trains(); ++t)
+			energy[t] = measureEnergy(t);
+		settle = false;
+	}
+
+	for (int t = 0; t < trains(); ++t)
+	{
+		origional_speed[t] = dir * (speed[t] * .1f);
+
+		if (physics)
+		{
+			// wait for the train in front to get out of the way
+			if (braking && braked[t])
+			{
+				velocity[t] = 0;
+				energy[t] = measureEnergy(t);
+			}
+			else
+				roll(t, dir);
+
+			physics_effected_speed[t] = velocity[t];
+			continue;
+		}
+
+		float s = origional_speed[t];
+		s = fmod(n + s, n);
+		if (fabs(s) < Min_Speed)
+		{
+			s = Min_Speed * pow(-1.0, signbit(dir));
+		}
+		if (fabs(s) > Max_Speed)
+		{
+			s = Max_Speed * pow(-1.0, signbit(dir));
+		}
+
+		physics_effected_speed[t] = 0.0;
+		velocity[t] = 0;
+
+		// wait for the train in front to get out of the way
+		if (braking && braked[t])
+			continue;
+
+		// with arc length the step is a distance (75 per unit of parameter,
+		// about the length of a segment)
+		if (arcLength)
+			moveTo(t, distance[t] + s * 75);
+		else
+		{
+			head[t] = fmod(n + head[t] + s, n);
+			distance[t] = table.distance(head[t]);
+			written[t] = head[t];
+		}
+	}
+
+	// the energies are stale once the trains moved without physics
+	if (!physics)
+		settle = true;
+}
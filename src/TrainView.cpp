@@ -34,11 +34,15 @@
 // we will need OpenGL, and OpenGL needs windows.h
 #include <windows.h>
 #include "GL/gl.h"
-#include <glm/glm.hpp>
-#include <glm/gtc/type_ptr.hpp>
 #include "GL/glu.h"
+#include <Fl/gl.h>
+
+#include <algorithm>
+#include <iterator>
+#include <random>
 
 #include "TrainView.H"
+#include "Jobs.H"
 #include "TrainWindow.H"
 #include "Utilities/3DUtils.H"
 #include "Utilities/Pnt3f.H"
@@ -51,6 +55,16 @@
 // #endif
 
 
+//************************************************************************
+//
+// * a mesh is still being built, draw again once it might be done
+//========================================================================
+static void meshesPending(void* view)
+//========================================================================
+{
+	((TrainView*) view)->damage(1);
+}
+
 //************************************************************************
 //
 // * Constructor to set up the GL window
@@ -63,9 +77,38 @@ TrainView(int x, int y, int w, int h, const char* l)
 	mode( FL_RGB|FL_ALPHA|FL_DOUBLE | FL_STENCIL );
 	this->selectedCube = -1;
 	this->seed = (unsigned) time(NULL);
+	this->dirty = Dirty_All;
+	this->builtClearance = false;
+	this->waitForMeshes = false;
+	this->buildSpline = -1;
+	this->buildArcLength = false;
+	this->buildSeed = 0;
+	this->buildDetail = N_dT;
+	this->meshSpline = -1;
+	this->meshArcLength = false;
+	this->tiesStale = true;
+	this->dragging = false;
+	this->dragPending = false;
+	this->dragX = this->dragY = 0;
+	this->dragElevator = false;
+	this->selecting = Select_None;
+	this->selectAdd = false;
 	resetArcball();
 }
 
+//************************************************************************
+//
+// * the builds on the workers write into this view, let them finish
+//========================================================================
+TrainView::
+~TrainView()
+//========================================================================
+{
+	Fl::remove_timeout(meshesPending, this);
+	JobPool::shared().wait(meshJobs);
+	JobPool::shared().wait(trackJobs);
+}
+
 //************************************************************************
 //
 // * Reset the camera to look at the world
@@ -95,8 +138,10 @@ int TrainView::handle(int event)
 	// then we're done
 	// note: the arcball only gets the event if we're in world view
 	if (tw->worldCam->value())
-		if (arcball.handle(event)) 
+		if (arcball.handle(event)) {
+			tw->m_Latency.stamp();
 			return 1;
+		}
 
 	// remember what button was used
 	static int last_push;
@@ -107,6 +152,7 @@ int TrainView::handle(int event)
 			last_push = Fl::event_button();
 			// if the left button be pushed is left mouse button
 			if (last_push == FL_LEFT_MOUSE  ) {
+				tw->m_Latency.stamp();
 				doPick();
 				damage(1);
 				return 1;
@@ -115,6 +161,10 @@ int TrainView::handle(int event)
 
 	   // Mouse button release event
 		case FL_RELEASE: // button release
+			tw->m_Latency.stamp();
+			if (selecting != Select_None)
+				endSelecting();
+			endDrag();
 			damage(1);
 			last_push = 0;
 			return 1;
@@ -122,26 +172,24 @@ int TrainView::handle(int event)
 		// Mouse button drag event
 		case FL_DRAG:
 
-			// Compute the new control point position
-			if ((last_push == FL_LEFT_MOUSE) && (selectedCube >= 0)) {
-				ControlPoint* cp = &m_pTrack->points[selectedCube];
-
-				double r1x, r1y, r1z, r2x, r2y, r2z;
-				getMouseLine(r1x, r1y, r1z, r2x, r2y, r2z);
-
-				double rx, ry, rz;
-				mousePoleGo(r1x, r1y, r1z, r2x, r2y, r2z, 
-								static_cast<double>(cp->pos.x), 
-								static_cast<double>(cp->pos.y),
-								static_cast<double>(cp->pos.z),
-								rx, ry, rz,
-								(Fl::event_state() & FL_CTRL) != 0);
-
-				cp->pos.x = (float) rx;
-				cp->pos.y = (float) ry;
-				cp->pos.z = (float) rz;
-				damage(1);
+			if (selecting != Select_None) {
+				// the box follows the mouse, the lasso gets a corner
+				const float x = (float) Fl::event_x(), y = (float) (h() - Fl::event_y());
+				const size_t n = selectPath.size();
+				if (selecting == Select_Box)
+					selectPath.resize(2);
+				if (selecting == Select_Box ||
+					 fabs(x - selectPath[n - 2]) + fabs(y - selectPath[n - 1]) >= Lasso_Step) {
+					selectPath.push_back(x);
+					selectPath.push_back(y);
+					damage(1);
+				}
+				return 1;
 			}
+
+			// Compute the new control point position
+			if ((last_push == FL_LEFT_MOUSE) && (selectedCube >= 0))
+				dragTo(Fl::event_x(), Fl::event_y(), (Fl::event_state() & FL_CTRL) != 0);
 			break;
 
 		// in order to get keyboard events, we need to accept focus
@@ -158,7 +206,7 @@ int TrainView::handle(int event)
 				int ks = Fl::event_state();
 				if (k == 'p') {
 					// Print out the selected control point information
-					if (selectedCube >= 0) 
+					if (selectedCube >= 0) {
 						printf("Selected(%d) (%g %g %g) (%g %g %g)\n",
 								 selectedCube,
 								 m_pTrack->points[selectedCube].pos.x,
@@ -167,14 +215,34 @@ int TrainView::handle(int event)
 								 m_pTrack->points[selectedCube].orient.x,
 								 m_pTrack->points[selectedCube].orient.y,
 								 m_pTrack->points[selectedCube].orient.z);
+						if (selection.size() > 1)
+							printf("and %d more points\n", (int) selection.size() - 1);
+					}
+					else if (!selection.empty())
+						printf("Selected %d points\n", (int) selection.size());
 					else
 						printf("Nothing Selected\n");
 
 					return 1;
 				};
 				if (k == 's') {
-					printf("Original Speed (%.2lfx): %lf\n", this->tw->speed->value(), this->tw->origional_speed);
-					printf("Physics Effected Speed: %lf\n", this->tw->physics_effected_speed);
+					printf("Original Speed (%.2lfx): %lf\n", this->tw->speed->value(), this->tw->m_Sim.origional_speed[0]);
+					printf("Physics Effected Speed: %lf\n", this->tw->m_Sim.physics_effected_speed[0]);
+				}
+				if ((ks & FL_CTRL) && (k == 'z' || k == 'y')) {
+					// undo, redo with ctrl-y or ctrl-shift-z
+					tw->m_Latency.stamp();
+					const bool again = k == 'y' || (ks & FL_SHIFT);
+					if (again ? tw->m_History.redo(*m_pTrack) : tw->m_History.undo(*m_pTrack))
+						tw->damageMe(Dirty_Track);
+					return 1;
+				}
+				if (k == 'l') {
+					// how long the input waited for its frame
+					const LatencyLog& latency = this->tw->m_Latency;
+					printf("Input to frame (%d events): p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+							 (int) latency.count(), latency.percentile(50), latency.percentile(95),
+							 latency.percentile(99), latency.worst());
 				}
 				break;
 	}
@@ -203,6 +271,12 @@ void TrainView::draw()
 	// else
 	// 	throw std::runtime_error("Could not initialize GLAD!");
 
+	this->tw->m_Frames.begin();
+	Mesh::drawn.calls = Mesh::drawn.vertices = 0;
+
+	// the cars as the simulation last published them, for the whole frame
+	this->tw->m_Poses.read();
+
 	// Set up the view port
 	glViewport(0,0,w(),h());
 
@@ -223,6 +297,12 @@ void TrainView::draw()
 	glLoadIdentity();
 	setProjection();		// put the code to set up matrices here
 
+	// the drag since the last frame, with the matrices it was made in
+	if (dragPending) {
+		applyDrag();
+		this->tw->m_Poses.read();
+	}
+
 	//######################################################################
 	// TODO: 
 	// you might want to set the lighting up differently. if you do, 
@@ -276,7 +356,12 @@ void TrainView::draw()
 
 	setupFloor();
 	glDisable(GL_LIGHTING);
-	drawFloor(200,10);
+	const int floorSquares = 10;
+	drawFloor(200,floorSquares);
+	// drawn in immediate mode (so are the control points), a glBegin
+	// counts as a call
+	++Mesh::drawn.calls;
+	Mesh::drawn.vertices += 4 * floorSquares * floorSquares;
 
 
 	//*********************************************************************
@@ -286,152 +371,121 @@ void TrainView::draw()
 	glEnable(GL_LIGHTING);
 	setupObjects();
 
+	// tessellate once - both passes below draw the same meshes
+	updateMeshes();
+
 	drawStuff();
 
 	// this time drawing is for shadows (except for top view)
+	// the shadows just redraw the meshes under the squishing matrix
 	if (!tw->topCam->value()) {
 		setupShadows();
 		drawStuff(true);
 		unsetupShadows();
 	}
+
+	this->tw->m_Frames.end(Mesh::drawn.calls, Mesh::drawn.vertices);
+	if (selecting != Select_None)
+		drawSelecting();
+	if (this->tw->statsButton->value())
+		drawStats();
+
+	// everything stamped until now is in this frame
+	this->tw->m_Latency.frameDone();
 }
 
+//************************************************************************
+//
+// * a graph of the frame times (green) and the draw times (yellow) of the
+//   frames kept, the newest on the right, with lines at 60 and 30 fps,
+//   and the numbers of the last frame under it
+//========================================================================
 void TrainView::
-getCurvesPoint(const float t, Pnt3f* pos, Pnt3f* dir, Pnt3f* up)
+drawStats()
+//========================================================================
 {
-	int i = (int) fmod(t, this->tw->m_Track.points.size());
-	const float p = t - i;
-
-	const int s0 = i > 0 ?
-				(i - 1) % this->tw->m_Track.points.size() : this->tw->m_Track.points.size() - 1;
-	const int s1 = (i + 0) % this->tw->m_Track.points.size();
-	const int s2 = (i + 1) % this->tw->m_Track.points.size();
-	const int s3 = (i + 2) % this->tw->m_Track.points.size();
-
-	const ControlPoint* p0 = &(this->m_pTrack->points[s0]);
-	const ControlPoint* p1 = &(this->m_pTrack->points[s1]);
-	const ControlPoint* p2 = &(this->m_pTrack->points[s2]);
-	const ControlPoint* p3 = &(this->m_pTrack->points[s3]);
-
-	static const float mat44_Carriental[16] = {
-		-1 / 2.0,  3 / 2.0, -3 / 2.0,  1 / 2.0,
-		 2 / 2.0, -5 / 2.0,  4 / 2.0, -1 / 2.0,
-		-1 / 2.0,  0 / 2.0,  1 / 2.0,  0 / 2.0,
-		 0 / 2.0,  2 / 2.0,  0 / 2.0,  0 / 2.0
-	};
-	static const glm::mat4x4 Carriental = glm::make_mat4x4(mat44_Carriental);
-
-	static const float mat44_B_Spline[16] = {
-		-1 / 6.0,  3 / 6.0, -3 / 6.0,  1 / 6.0,
-		 3 / 6.0, -6 / 6.0,  3 / 6.0,  0 / 6.0,
-		-3 / 6.0,  0 / 6.0,  3 / 6.0,  0 / 6.0,
-		 1 / 6.0,  4 / 6.0,  1 / 6.0,  0 / 6.0
-	};
-	static const glm::mat4x4 B_Spline = glm::make_mat4x4(mat44_B_Spline);
-
-	const float mat43_G[12] = {
-		p0->pos.x, p0->pos.y, p0->pos.z,
-		p1->pos.x, p1->pos.y, p1->pos.z,
-		p2->pos.x, p2->pos.y, p2->pos.z,
-		p3->pos.x, p3->pos.y, p3->pos.z
-	};
-	const glm::mat4x3 G = glm::make_mat4x3(mat43_G);
-
-	const float mat43_O[12] = {
-		p0->orient.x, p0->orient.y, p0->orient.z,
-		p1->orient.x, p1->orient.y, p1->orient.z,
-		p2->orient.x, p2->orient.y, p2->orient.z,
-		p3->orient.x, p3->orient.y, p3->orient.z
-	};
-	const glm::mat4x3 O = glm::make_mat4x3(mat43_O);
-
-	const float vec4_T[4] = {
-		(float) std::pow(p, 3),
-		(float) std::pow(p, 2),
-		(float) std::pow(p, 1),
-		(float) std::pow(p, 0)
-	};
-	const glm::vec4 T = glm::make_vec4(vec4_T);
-
-	const float vec4_dT[4] = {
-		(float) (3.0 * std::pow(p, 2)),
-		(float) (2.0 * std::pow(p, 1)),
-		(float) (1.0 * std::pow(p, 0)),
-		(float) (0.0 * std::pow(p, 0))
-	};
-	const glm::vec4 dT = glm::make_vec4(vec4_dT);
-
-	if (this->tw->splineBrowser->selected(1))
-	{
-		if (pos != NULL)
-		{
-			(*pos) = (1 - p) * p1->pos + p * p2->pos;
-		}
-		if (dir != NULL)
-		{
-			(*dir) = (p2->pos + -1.0 * p1->pos);
-			(*dir).normalize();
-		}
-		if (up != NULL)
-		{
-			(*up) = (1 - p) * p1->orient + p * p2->orient;
-			(*up).normalize();
-		}
-	}
-	else if (this->tw->splineBrowser->selected(2))
-	{
-		const glm::vec3 Q = G * Carriental * T;
-		const glm::vec3 dQ = G * Carriental * dT;
-		const glm::vec3 Ot = O * Carriental * T;
+	const FrameStats& stats = this->tw->m_Frames;
+	const int n = stats.count();
+	if (n == 0)
+		return;
 
-		if (pos != NULL)
-		{
-			(*pos).x = Q.x;
-			(*pos).y = Q.y;
-			(*pos).z = Q.z;
-		}
-		if (dir != NULL)
-		{
-			(*dir).x = dQ.x;
-			(*dir).y = dQ.y;
-			(*dir).z = dQ.z;
-			(*dir).normalize();
-		}
-		if (up != NULL)
-		{
-			(*up).x = Ot.x;
-			(*up).y = Ot.y;
-			(*up).z = Ot.z;
-			(*up).normalize();
-		}
+	// straight into window coordinates, over everything
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glOrtho(0, w(), 0, h(), -1, 1);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+	glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT | GL_COLOR_BUFFER_BIT);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_STENCIL_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	const float x0 = 10, y0 = 10;
+	const float gw = (float) Frame_Stats_Frames, gh = 80;
+
+	glColor4f(0, 0, 0, 0.6f);
+	glBegin(GL_QUADS);
+		glVertex2f(x0 - 5, y0 - 5);
+		glVertex2f(x0 + gw + 5, y0 - 5);
+		glVertex2f(x0 + gw + 5, y0 + gh + 40);
+		glVertex2f(x0 - 5, y0 + gh + 40);
+	glEnd();
+
+	glColor4f(1, 1, 1, 0.3f);
+	glBegin(GL_LINES);
+	for (int fps = 30; fps <= 60; fps += 30) {
+		const float y = y0 + gh * (float) (1000.0 / fps / Stats_Graph_Ms);
+		glVertex2f(x0, y);
+		glVertex2f(x0 + gw, y);
 	}
-	else if (this->tw->splineBrowser->selected(3))
-	{
-		const glm::vec3 Q = G * B_Spline * T;
-		const glm::vec3 dQ = G * B_Spline * dT;
-		const glm::vec3 Ot = O * B_Spline * T;
+	glEnd();
 
-		if (pos != NULL)
-		{
-			(*pos).x = Q.x;
-			(*pos).y = Q.y;
-			(*pos).z = Q.z;
-		}
-		if (dir != NULL)
-		{
-			(*dir).x = dQ.x;
-			(*dir).y = dQ.y;
-			(*dir).z = dQ.z;
-			(*dir).normalize();
-		}
-		if (up != NULL)
-		{
-			(*up).x = Ot.x;
-			(*up).y = Ot.y;
-			(*up).z = Ot.z;
-			(*up).normalize();
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		if (pass == 0)
+			glColor3ub(60, 220, 60);
+		else
+			glColor3ub(240, 240, 30);
+		glBegin(GL_LINE_STRIP);
+		for (int k = n - 1; k >= 0; --k) {
+			const FrameSample& s = stats.sample(k);
+			const double ms = pass == 0 ? s.frame : s.draw;
+			glVertex2f(x0 + gw - 1 - k, y0 + gh * (float) std::min(1.0, ms / Stats_Graph_Ms));
 		}
+		glEnd();
 	}
+
+	const FrameSample& last = stats.sample(0);
+	char line[160];
+	glColor3ub(255, 255, 255);
+	gl_font(FL_HELVETICA, 12);
+	snprintf(line, sizeof(line), "%.1f fps  frame p99 %.1f ms  draw %.2f ms (p99 %.2f)",
+				stats.fps(), stats.framePercentile(99), last.draw, stats.drawPercentile(99));
+	gl_draw(line, x0, y0 + gh + 22);
+	snprintf(line, sizeof(line), "%ld draws  %ld vertices  %lld curve points",
+				last.drawCalls, last.vertices, last.curvePoints);
+	gl_draw(line, x0, y0 + gh + 6);
+
+	glPopAttrib();
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+}
+
+//************************************************************************
+//
+// * the point on the curve at t, using the selected spline type
+//========================================================================
+void TrainView::
+getCurvesPoint(const double t, Pnt3f* pos, Pnt3f* dir, Pnt3f* up)
+//========================================================================
+{
+	::getCurvesPoint(this->m_pTrack->points, this->tw->splineBrowser->value(), t, pos, dir, up);
 }
 
 //************************************************************************
@@ -480,8 +534,8 @@ setProjection()
 		glLoadIdentity();
 		gluPerspective(70, aspect, 0.1, 1000);
 
-		Pnt3f pos, dir, up;
-		getCurvesPoint(this->tw->m_Track.trainU, &pos, &dir, &up);
+		const TrainPoses& poses = this->tw->m_Poses.current();
+		Pnt3f pos = poses.eye, dir = poses.look, up = poses.up;
 		pos = pos + (up * Train_Height * 0.5) + (dir * Train_Length * 0.5);
 		dir = pos + dir;
 
@@ -498,6 +552,7 @@ setProjection()
 //	NOTE: if you're drawing shadows, DO NOT set colors (otherwise, you get 
 //       colored shadows). this gets called twice per draw 
 //       -- once for the objects, once for the shadows
+//       the geometry is built by updateMeshes, this only draws it
 //########################################################################
 // TODO: 
 // if you have other objects in the world, make sure to draw them
@@ -509,15 +564,23 @@ void TrainView::drawStuff(bool doingShadows)
 	// don't draw the control points if you're driving 
 	// (otherwise you get sea-sick as you drive through them)
 	if (!tw->trainCam->value()) {
+		// (the selection is in order, it is walked along with the points)
+		size_t next = 0;
 		for(size_t i=0; i<m_pTrack->points.size(); ++i) {
+			const bool selected = next < selection.size() && selection[next] == (int) i;
+			if (selected)
+				++next;
 			if (!doingShadows) {
-				if ( ((int) i) != selectedCube)
+				if (!selected)
 					glColor3ub(240, 60, 60);
 				else
 					glColor3ub(240, 240, 30);
 			}
 			m_pTrack->points[i].draw();
 		}
+		const long n = (long) m_pTrack->points.size();
+		Mesh::drawn.calls += n * Control_Point_Batches;
+		Mesh::drawn.vertices += n * Control_Point_Vertices;
 	}
 	// draw the track
 	//####################################################################
@@ -526,7 +589,7 @@ void TrainView::drawStuff(bool doingShadows)
 	//####################################################################
 
 // #ifdef EXAMPLE_SOLUTION
-	drawTrack(doingShadows);
+	trackMeshes.draw(!doingShadows);
 // #endif
 
 	// draw the train
@@ -537,74 +600,324 @@ void TrainView::drawStuff(bool doingShadows)
 // #ifdef EXAMPLE_SOLUTION
 // 	// don't draw the train if you're looking out the front window
 	if (!tw->trainCam->value())
-		drawTrain(doingShadows);
+		carMesh.drawInstances(this->tw->m_Poses.current().frames, !doingShadows);
 // #endif
 	// DEBUG_INFO("%d\n", tw->trainCam->value());
 
-	drawOthers(doingShadows);
+	othersMeshes.draw(!doingShadows);
+
+	if (!doingShadows && builtClearance)
+		clearanceMesh.draw();
 }
 
-// x-> u, y -> v
-static inline void drawOwO(Pnt3f np, Pnt3f nu, Pnt3f nv, Pnt3f fp, Pnt3f fu, Pnt3f fv,
-					  float hw, float hh, bool dnfs)
+//************************************************************************
+//
+// * just remember where the mouse went, the next frame moves the point
+//   there - the events come in a lot faster than frames on a long track
+//========================================================================
+void TrainView::
+dragTo(const int x, const int y, const bool elevator)
+//========================================================================
 {
-	glPushMatrix();
-	glEnable(GL_NORMALIZE);
-	glBegin(GL_QUADS);
+	tw->m_Latency.stamp();
+
+	dragX = x;
+	dragY = y;
+	dragElevator = elevator;
+	if (!dragging) {
+		dragging = true;
+		tw->m_Sim.holdTable = true;
+	}
+	if (!dragPending) {
+		dragPending = true;
+		damage(1);
+	}
+}
+
+//************************************************************************
+//
+// * the track in full detail again, and the trains measure it again (a
+//   drag that is still pending does that when it's done)
+//========================================================================
+void TrainView::
+endDrag()
+//========================================================================
+{
+	if (!dragging)
+		return;
+
+	dragging = false;
+	tw->m_History.commit();
+	tw->m_Sim.holdTable = false;
+	invalidate(Dirty_Track);
+	if (!dragPending)
+		tw->damageMe(Dirty_Trains);
+}
+
+//************************************************************************
+//
+// * this is in the middle of a draw, so the window isn't damaged again
+//   (what damageMe would do) - the trains are published straight away
+//========================================================================
+void TrainView::
+applyDrag()
+//========================================================================
+{
+	dragPending = false;
+	if (selectedCube < 0 || selectedCube >= (int) m_pTrack->points.size())
+		return;
+
+	ControlPoint cp = m_pTrack->points[selectedCube];
+
+	double r1x, r1y, r1z, r2x, r2y, r2z;
+	getMouseLine(dragX, dragY, r1x, r1y, r1z, r2x, r2y, r2z);
 
-	glNormal3f(nu.y * (fp.z - np.z + hh * (fv.z - nv.z)) - nu.z * (fp.y - np.y + hh * (fv.y - nv.y)),
-			 nu.z * (fp.x - np.x + hh * (fv.x - nv.x)) - nu.x * (fp.z - np.z + hh * (fv.z - nv.z)),
-			 nu.x * (fp.y - np.y + hh * (fv.y - nv.y)) - nu.y * (fp.x - np.x + hh * (fv.x - nv.x)));
-	glVertex3f(np.x - hw * nu.x + hh * nv.x, np.y - hw * nu.y + hh * nv.y, np.z - hw * nu.z + hh * nv.z);
-	glVertex3f(fp.x - hw * fu.x + hh * fv.x, fp.y - hw * fu.y + hh * fv.y, fp.z - hw * fu.z + hh * fv.z);
-	glVertex3f(fp.x + hw * fu.x + hh * fv.x, fp.y + hw * fu.y + hh * fv.y, fp.z + hw * fu.z + hh * fv.z);
-	glVertex3f(np.x + hw * nu.x + hh * nv.x, np.y + hw * nu.y + hh * nv.y, np.z + hw * nu.z + hh * nv.z);
-
-	glNormal3f(nu.z * (fp.y - np.y - hh * (fv.y - nv.y) - nu.y * (fp.z - np.z - hh * (fv.z - nv.z))),
-			 nu.x * (fp.z - np.z - hh * (fv.z - nv.z) - nu.z * (fp.x - np.x - hh * (fv.x - nv.x))),
-			 nu.y * (fp.x - np.x - hh * (fv.x - nv.x) - nu.x * (fp.y - np.y - hh * (fv.y - nv.y))));
-	glVertex3f(np.x - hw * nu.x - hh * nv.x, np.y - hw * nu.y - hh * nv.y, np.z - hw * nu.z - hh * nv.z);
-	glVertex3f(np.x + hw * nu.x - hh * nv.x, np.y + hw * nu.y - hh * nv.y, np.z + hw * nu.z - hh * nv.z);
-	glVertex3f(fp.x + hw * fu.x - hh * fv.x, fp.y + hw * fu.y - hh * fv.y, fp.z + hw * fu.z - hh * fv.z);
-	glVertex3f(fp.x - hw * fu.x - hh * fv.x, fp.y - hw * fu.y - hh * fv.y, fp.z - hw * fu.z - hh * fv.z);
-	
-	glNormal3f((fp.y - np.y - hw * (fv.y - nu.y)) * nv.z - (fp.z - np.z - hw * (fv.z - nu.z)) * nv.y,
-			 (fp.z - np.z - hw * (fv.z - nu.z)) * nv.x - (fp.x - np.x - hw * (fv.x - nu.x)) * nv.z,
-			 (fp.x - np.x - hw * (fv.x - nu.x)) * nv.y - (fp.y - np.y - hw * (fv.y - nu.y)) * nv.x);
-	glVertex3f(np.x - hw * nu.x - hh * nv.x, np.y - hw * nu.y - hh * nv.y, np.z - hw * nu.z - hh * nv.z);
-	glVertex3f(fp.x - hw * fu.x - hh * fv.x, fp.y - hw * fu.y - hh * fv.y, fp.z - hw * fu.z - hh * fv.z);
-	glVertex3f(fp.x - hw * fu.x + hh * fv.x, fp.y - hw * fu.y + hh * fv.y, fp.z - hw * fu.z + hh * fv.z);
-	glVertex3f(np.x - hw * nu.x + hh * nv.x, np.y - hw * nu.y + hh * nv.y, np.z - hw * nu.z + hh * nv.z);
-	
-	glNormal3f((fp.y - np.y + hw * (fv.y - nu.y)) * -nv.z - (fp.z - np.z + hw * (fv.z - nu.z)) * -nv.y,
-			 (fp.z - np.z + hw * (fv.z - nu.z)) * -nv.x - (fp.x - np.x + hw * (fv.x - nu.x)) * -nv.z,
-			 (fp.x - np.x + hw * (fv.x - nu.x)) * -nv.y - (fp.y - np.y + hw * (fv.y - nu.y)) * -nv.x);
-	glVertex3f(np.x + hw * nu.x + hh * nv.x, np.y + hw * nu.y + hh * nv.y, np.z + hw * nu.z + hh * nv.z);
-	glVertex3f(fp.x + hw * fu.x + hh * fv.x, fp.y + hw * fu.y + hh * fv.y, fp.z + hw * fu.z + hh * fv.z);
-	glVertex3f(fp.x + hw * fu.x - hh * fv.x, fp.y + hw * fu.y - hh * fv.y, fp.z + hw * fu.z - hh * fv.z);
-	glVertex3f(np.x + hw * nu.x - hh * nv.x, np.y + hw * nu.y - hh * nv.y, np.z + hw * nu.z - hh * nv.z);
-	
-	if (dnfs)
+	double rx, ry, rz;
+	mousePoleGo(r1x, r1y, r1z, r2x, r2y, r2z, 
+					static_cast<double>(cp.pos.x), 
+					static_cast<double>(cp.pos.y),
+					static_cast<double>(cp.pos.z),
+					rx, ry, rz,
+					dragElevator);
+
+	// the rest of the selection goes as far as the point the mouse has
+	const Pnt3f by((float) rx - cp.pos.x, (float) ry - cp.pos.y, (float) rz - cp.pos.z);
+
+	// (the whole drag is one command, committed when it is let go, and
+	// the track is built again once for all of the points)
+	for (size_t k = 0; k < selection.size(); ++k)
 	{
-		glNormal3f(np.x - fp.x, np.y - fp.y, np.z - fp.z);
-		glVertex3f(np.x - hw * nu.x - hh * nv.x, np.y - hw * nu.y - hh * nv.y, np.z - hw * nu.z - hh * nv.z);
-		glVertex3f(np.x - hw * nu.x + hh * nv.x, np.y - hw * nu.y + hh * nv.y, np.z - hw * nu.z + hh * nv.z);
-		glVertex3f(np.x + hw * nu.x + hh * nv.x, np.y + hw * nu.y + hh * nv.y, np.z + hw * nu.z + hh * nv.z);
-		glVertex3f(np.x + hw * nu.x - hh * nv.x, np.y + hw * nu.y - hh * nv.y, np.z + hw * nu.z - hh * nv.z);	
-	
-		glNormal3f(fp.x - np.x, fp.y - np.y, fp.z - np.z);
-		glVertex3f(fp.x - hw * fu.x - hh * fv.x, fp.y - hw * fu.y - hh * fv.y, fp.z - hw * fu.z - hh * fv.z);
-		glVertex3f(fp.x + hw * fu.x - hh * fv.x, fp.y + hw * fu.y - hh * fv.y, fp.z + hw * fu.z - hh * fv.z);
-		glVertex3f(fp.x + hw * fu.x + hh * fv.x, fp.y + hw * fu.y + hh * fv.y, fp.z + hw * fu.z + hh * fv.z);
-		glVertex3f(fp.x - hw * fu.x + hh * fv.x, fp.y - hw * fu.y + hh * fv.y, fp.z - hw * fu.z + hh * fv.z);	
+		ControlPoint p = m_pTrack->points[selection[k]];
+		p.pos = p.pos + by;
+		this->tw->m_History.move(*m_pTrack, selection[k], p);
 	}
-	
-	glEnd();
-	glPopMatrix();
+	invalidate(Dirty_Track);
+	this->tw->publishTrains();
 }
 
+//************************************************************************
+//
+// *
+//========================================================================
 void TrainView::
-drawTrack(bool doingShadows)
+invalidate(const unsigned changed)
+//========================================================================
+{
+	dirty |= changed;
+}
+
+//************************************************************************
+//
+// * Rebuild the meshes whose inputs changed since they were built
+//   the track depends on the points, the spline type and arc length
+//   the scenery only on the seed, the cars are one mesh that is drawn
+//   once per car, so only their frames change every frame. the shadows
+//   are the same meshes again, nothing of their own is built
+//
+//   what changed comes from the dirty bits, nothing is compared here -
+//   the trains and the camera have nothing built from them at all
+//
+//   the track and the scenery are built by jobs on the JobPool from a
+//   copy of their inputs, and swapped in at the start of the first frame
+//   after they are done - until then the old ones are drawn. an edit
+//   made while a build runs is picked up by the next build
+//
+//   while a point is dragged the track is built at Drag_Detail, and only
+//   the pieces around the point are, so the frame waits for it instead
+//   of showing the track where the point was. letting go builds the
+//   coarse pieces again in full
+//========================================================================
+void TrainView::
+updateMeshes()
+//========================================================================
+{
+	const int spline = this->tw->splineBrowser->value();
+	const int arcLength = this->tw->arcLength->value();
+
+	trackMeshes.swap();
+	othersMeshes.swap();
+
+	// (a bit stays set until a build could be started for it)
+	if ((dirty & Dirty_Scenery) && othersMeshes.start())
+	{
+		buildSeed = seed;
+		JobPool::shared().submit(meshJobs, [this]() {
+			Mesh* mesh = new Mesh;
+			buildOthers(*mesh);
+			othersMeshes.back().assign(1, std::shared_ptr<const Mesh>(mesh));
+			othersMeshes.finish();
+		});
+		dirty &= ~Dirty_Scenery;
+	}
+
+	if ((dirty & (Dirty_Track | Dirty_Spline)) && trackMeshes.start())
+	{
+		buildPoints = m_pTrack->points;
+		buildSpline = spline;
+		buildArcLength = arcLength != 0;
+		buildDetail = dragging ? Drag_Detail : N_dT;
+		JobPool::shared().submit(trackJobs, [this]() {
+			// (starts out as the pieces that are drawn now)
+			MeshPieces& pieces = trackMeshes.back();
+			pieces = trackMeshes.front();
+			buildTrack(pieces);
+			trackMeshes.finish();
+		});
+		dirty &= ~(Dirty_Track | Dirty_Spline);
+	}
+	dirty &= Dirty_Track | Dirty_Spline | Dirty_Scenery;
+
+	if (waitForMeshes) {
+		JobPool::shared().wait(meshJobs);
+		JobPool::shared().wait(trackJobs);
+	}
+	else if (dragging && buildDetail == Drag_Detail)
+		JobPool::shared().wait(trackJobs);
+
+	// (done already if they were waited for, or if the pool has no workers)
+	trackMeshes.swap();
+	othersMeshes.swap();
+
+	if ((trackMeshes.busy() || othersMeshes.busy()) && !Fl::has_timeout(meshesPending, this))
+		Fl::add_timeout(Mesh_Poll, meshesPending, this);
+
+	if (this->tw->clearanceButton->value())
+	{
+		if (clearance.update(*m_pTrack, spline) > 0 || !builtClearance)
+		{
+			clearanceMesh.clear();
+			clearanceMesh.color(255, 40, 40);
+			clearance.conflictBoxes(clearanceBoxes);
+			for (size_t k = 0; k < clearanceBoxes.size(); ++k)
+			{
+				const ClearanceBox& b = clearanceBoxes[k];
+				clearanceMesh.addBox(b.center + b.dir * -b.halfLength, b.side, b.up,
+											b.center + b.dir * b.halfLength, b.side, b.up,
+											b.halfWidth, b.halfHeight, true);
+			}
+			builtClearance = true;
+		}
+	}
+	else if (builtClearance)
+	{
+		// nothing is kept up to date while it isn't shown
+		clearance.clear();
+		clearanceMesh.clear();
+		builtClearance = false;
+	}
+
+	if (carMesh.size() == 0)
+		buildCar(carMesh);
+}
+
+//************************************************************************
+//
+// * the rails are tessellated Track_Piece segments at a time on the
+//   JobPool, every piece into a mesh of its own. pieces holds the ones
+//   of the last build, only those that changed are made again: the ones
+//   with a segment shaped by a point that moved (a segment uses the
+//   points from one before it to two after it), all of them after a
+//   new spline type, arc length or number of points, and the ones that
+//   were built coarse once the detail is back to N_dT
+//   everything comes from the snapshot, this runs on a worker
+//========================================================================
+void TrainView::
+buildTrack(MeshPieces& pieces)
+//========================================================================
+{
+	const int n = (int) buildPoints.size();
+	const bool arcLength = buildArcLength;
+	const int count = (n + Track_Piece - 1) / Track_Piece;
+
+	// with arc length the cross-ties are a piece of their own at the end
+	const int total = count + (arcLength ? 1 : 0);
+
+	std::vector<char> redo(count, 0);
+	bool changed = false;
+	if (buildSpline != meshSpline || arcLength != meshArcLength ||
+		 (int) meshPoints.size() != n || (int) pieces.size() != total)
+	{
+		pieces.assign(total, std::shared_ptr<const Mesh>());
+		pieceDetail.assign(count, 0);
+		redo.assign(count, 1);
+		changed = true;
+	}
+	else
+	{
+		for (int j = 0; j < n; ++j)
+		{
+			const ControlPoint& a = buildPoints[j];
+			const ControlPoint& b = meshPoints[j];
+			if (a.pos.x == b.pos.x && a.pos.y == b.pos.y && a.pos.z == b.pos.z &&
+				 a.orient.x == b.orient.x && a.orient.y == b.orient.y && a.orient.z == b.orient.z)
+				continue;
+			for (int i = j - 2; i <= j + 1; ++i)
+				redo[((i % n) + n) % n / Track_Piece] = 1;
+			changed = true;
+		}
+	}
+	for (int p = 0; p < count; ++p)
+		if (buildDetail == N_dT && pieceDetail[p] != N_dT)
+			redo[p] = 1;
+
+	std::vector<int> build;
+	for (int p = 0; p < count; ++p)
+		if (redo[p])
+			build.push_back(p);
+
+	JobPool::shared().parallelFor((int) build.size(), 1, [&](int begin, int end) {
+		for (int k = begin; k < end; ++k)
+		{
+			const int p = build[k];
+			Mesh* mesh = new Mesh;
+			buildRails(*mesh, p * Track_Piece, std::min(n, (p + 1) * Track_Piece), buildDetail, !arcLength);
+			pieces[p].reset(mesh);
+			pieceDetail[p] = buildDetail;
+		}
+	});
+
+	// with arc length they are evenly spaced along the track, the table
+	// says where. measuring the track takes long, so they wait for the
+	// full detail build (and are where they were while a point is dragged)
+	if (changed)
+		tiesStale = true;
+	if (arcLength && buildDetail == N_dT && (tiesStale || !pieces[count]))
+	{
+		ArcLengthTable& table = buildTable;
+		table.update(buildPoints, buildSpline);
+
+		Mesh* mesh = new Mesh;
+		const int ties = (int) (table.length() / Crosstie_Spacing);
+		if (ties > 0)
+		{
+			std::vector<double> t(ties);
+			std::vector<Pnt3f> sPos(ties), sDir(ties), sUp(ties);
+			for (int k = 0; k < ties; ++k)
+				t[k] = table.parameter(k * Crosstie_Spacing);
+			::getCurvesPoints(buildPoints, buildSpline, &t[0], ties,
+									&sPos[0], &sDir[0], &sUp[0]);
+
+			mesh->color(90, 50, 0);
+			for (int k = 0; k < ties; ++k)
+				addCrosstie(*mesh, sPos[k], sDir[k], sUp[k]);
+		}
+		pieces[count].reset(mesh);
+		tiesStale = false;
+	}
+
+	meshPoints = buildPoints;
+	meshSpline = buildSpline;
+	meshArcLength = arcLength;
+}
+
+//************************************************************************
+//
+// * the rails of segments first to last (not included), detail samples
+//   per segment, and ten cross-ties per segment if ties is set
+//========================================================================
+void TrainView::
+buildRails(Mesh& mesh, const int first, const int last, const int detail, const bool ties)
+//========================================================================
 {
 	Pnt3f pos, pos_next;
 	Pnt3f dir, dir_next;
@@ -614,17 +927,29 @@ drawTrack(bool doingShadows)
 
 	Pnt3f p0, p1;
 
-	float l = 0.0;
-
-	for (int i = 0; i < this->m_pTrack->points.size(); i++)
+	// every sample of the curve in one batch, sample k is at k / detail
+	const int n = (int) buildPoints.size();
+	const int samples = (last - first) * detail;
+	const int tieEvery = std::max(1, detail / 10);
+	std::vector<double> t(samples + 1);
+	std::vector<Pnt3f> sPos(samples + 1), sDir(samples + 1), sUp(samples + 1);
+	for (int k = 0; k <= samples; ++k)
+		t[k] = fmod(first + (double) k / detail, (double) n);
+	::getCurvesPoints(buildPoints, buildSpline, &t[0], samples + 1,
+							&sPos[0], &sDir[0], &sUp[0]);
+
+	for (int i = first; i < last; i++)
 	{
-		for (int j = 0; j < N_dT; ++j)
+		for (int j = 0; j < detail; ++j)
 		{
-			const float t0 = fmod(i + (j + 0.0) / N_dT, this->m_pTrack->points.size());
-			const float t1 = fmod(i + (j + 1.0) / N_dT, this->m_pTrack->points.size());
+			const int k = (i - first) * detail + j;
 
-			getCurvesPoint(t0, &pos, &dir, &up);
-			getCurvesPoint(t1, &pos_next, &dir_next, &up_next);
+			pos = sPos[k];
+			dir = sDir[k];
+			up = sUp[k];
+			pos_next = sPos[k + 1];
+			dir_next = sDir[k + 1];
+			up_next = sUp[k + 1];
 
 			cross = dir * up;
 			cross.normalize();
@@ -640,153 +965,132 @@ drawTrack(bool doingShadows)
 
 			// track
 
-			if (!doingShadows)
 			{
-				const float p = (i + ((float) j) / N_dT) / this->m_pTrack->points.size();
+				const float p = (i + ((float) j) / detail) / n;
 				const float r = 0.0 / 3.0 <= p && p <= 2.0 / 3.0 ? 255.0 * 3.0 * (1.0 / 3.0 - abs(1.0 / 3.0 - p)) : 0.0;
 				const float g = 1.0 / 3.0 <= p && p <= 3.0 / 3.0 ? 255.0 * 3.0 * (1.0 / 3.0 - abs(2.0 / 3.0 - p)) : 0.0;
 				const float b = 2.0 / 3.0 <= p || p <= 1.0 / 3.0 ? 255.0 * 3.0 * (1.0 / 6.0 - abs(1.0 / 2.0 - p)) : 0.0;
-				glColor3ub(r, g, b);
+				mesh.color((unsigned char) r, (unsigned char) g, (unsigned char) b);
 			}
 
 			// left hand side
 			p0 = pos + on * -(Track_Height / 2.0) + cross * -(Track_Gauge / 2.0);
 			p1 = pos_next + on_next * -(Track_Height / 2.0) + cross_next * -(Track_Gauge / 2.0);
-			drawOwO(p0, cross, on, p1, cross_next, on_next, Track_Width / 2.0, Track_Height / 2.0, false);
+			mesh.addBox(p0, cross, on, p1, cross_next, on_next, Track_Width / 2.0, Track_Height / 2.0, false);
 
 			// right hand side
 			p0 = pos + on * -(Track_Height / 2.0) + cross * (Track_Gauge / 2.0);
 			p1 = pos_next + on_next * -(Track_Height / 2.0) + cross_next * (Track_Gauge / 2.0);
-			drawOwO(p0, cross, on, p1, cross_next, on_next, Track_Width / 2.0, Track_Height / 2.0, false);
-
-			// cross-tie
-
-			if (!doingShadows)
-			{
-				glColor3ub(90, 50, 0);
-			}
+			mesh.addBox(p0, cross, on, p1, cross_next, on_next, Track_Width / 2.0, Track_Height / 2.0, false);
 
-			l += sqrt(pow(pos_next.x - pos.x, 2) + pow(pos_next.y - pos.y, 2) + pow(pos_next.z - pos.z, 2));
+			// cross-tie, ten per segment without arc length
 
-			if ((this->tw->arcLength->value() == 1 && l >= Crosstie_Spacing) || (this->tw->arcLength->value() == 0 && j % (N_dT / 10) == 0))
+			if (ties && j % tieEvery == 0)
 			{
-				p0 = pos + on * -(Track_Height + Crosstie_Height / 2.0) + dir * -(Crosstie_Width / 2.0);
-				p1 = pos + on * -(Track_Height + Crosstie_Height / 2.0) + dir * (Crosstie_Width / 2.0);
-				drawOwO(p0, cross, on, p1, cross, on, Crosstie_Lenght / 2.0, Crosstie_Height / 2.0, true);
-				l -= Crosstie_Spacing;
+				mesh.color(90, 50, 0);
+				addCrosstie(mesh, pos, dir, up);
 			}
 		}
 	}
 }
 
+//************************************************************************
+//
+// * one cross-tie under the track at pos
+//========================================================================
 void TrainView::
-drawTrain(bool doingShadows)
+addCrosstie(Mesh& mesh, const Pnt3f& pos, const Pnt3f& dir, const Pnt3f& up)
+//========================================================================
 {
-	Pnt3f pos, pos_next, dir, up;
-	Pnt3f cross, on, p0, p1;
+	Pnt3f cross = dir * up;
+	cross.normalize();
 
-	float l = 0.0;
+	Pnt3f on = cross * dir;
+	on.normalize();
 
-	for (int k = 0, i = 0; k < this->tw->train_amount && i < this->m_pTrack->points.size(); i++)
-	{
-		for (int j = 0; k < this->tw->train_amount && j < N_dT; ++j)
-		{
-			const float t0 = fmod(this->tw->m_Track.trainU + this->m_pTrack->points.size() - 1.0 - i + (N_dT - j - 0.0) / N_dT, this->m_pTrack->points.size());
-			const float t1 = fmod(this->tw->m_Track.trainU + this->m_pTrack->points.size() - 1.0 - i + (N_dT - j - 1.0) / N_dT, this->m_pTrack->points.size());
-			
-			getCurvesPoint(t0, &pos, &dir, &up);
-			getCurvesPoint(t1, &pos_next, NULL, NULL);
-
-			if (l >= 0.0)
-			{
-				this->tw->train_position[k] = t0;
-
-				cross = dir * up;
-				cross.normalize();
-
-				on = cross * dir;
-				on.normalize();
-
-				if (!doingShadows)
-				{
-					glColor3ub(160, 120, 0);
-				}
+	const Pnt3f p0 = pos + on * -(Track_Height + Crosstie_Height / 2.0) + dir * -(Crosstie_Width / 2.0);
+	const Pnt3f p1 = pos + on * -(Track_Height + Crosstie_Height / 2.0) + dir * (Crosstie_Width / 2.0);
+	mesh.addBox(p0, cross, on, p1, cross, on, Crosstie_Lenght / 2.0, Crosstie_Height / 2.0, true);
+}
 
-				p0 = pos + dir * -(Train_Length / 2.0) + on * (Train_Height / 2.0);
-				p1 = pos + dir * (Train_Length / 2.0) + on * (Train_Height / 2.0);
-				drawOwO(p0, cross, on, p1, cross, on, Train_Width / 2.0, Train_Height / 2.0, true);
+//************************************************************************
+//
+// * one car, in its own frame: x is across the track, y is up and z is
+//   along the track, the origin is on the track under its middle
+//========================================================================
+void TrainView::
+buildCar(Mesh& mesh)
+//========================================================================
+{
+	const Pnt3f cross(1, 0, 0), on(0, 1, 0);
 
-				l -= Train_Length + Train_Gap;
-				k++;
-			}
-			l += sqrt(pow(pos_next.x - pos.x, 2) + pow(pos_next.y - pos.y, 2) + pow(pos_next.z - pos.z, 2));
-		}
-	}
+	mesh.color(160, 120, 0);
+	mesh.addBox(Pnt3f(0, Train_Height / 2.0, -Train_Length / 2.0), cross, on,
+					Pnt3f(0, Train_Height / 2.0,  Train_Length / 2.0), cross, on,
+					Train_Width / 2.0, Train_Height / 2.0, true);
 }
 
+//************************************************************************
+//
+// * rocks and trees, placed by the seed of the snapshot
+//========================================================================
 void TrainView::
-drawOthers(bool doingShadows)
+buildOthers(Mesh& mesh)
+//========================================================================
 {
-	srand( this->seed );
+	// an engine of its own - this runs on a worker, and the same seed has
+	// to give the same scenery whatever else calls rand()
+	std::minstd_rand rng( buildSeed );
 
-	unsigned stone_amount = 16 + rand() % 32;
+	unsigned stone_amount = 16 + rng() % 32;
 
 	for (int i = 0; i < stone_amount; ++i)
 	{
-		if (!doingShadows)
-		{
-			glColor3ub(80, 80, 80);
-		}
+		mesh.color(80, 80, 80);
 
-		float x = 100.0 - rand() % 200 + 0.01 * (rand() % 100);
-		float z = 100.0 - rand() % 200 + 0.01 * (rand() % 100);
+		float x = 100.0 - rng() % 200 + 0.01 * (rng() % 100);
+		float z = 100.0 - rng() % 200 + 0.01 * (rng() % 100);
 		
-		float w = 1.0 + 0.1 * (rand() % 50);
-		float h = 0.5 + 0.1 * (rand() % 30);
-		float r = (rand() % 360) * M_PI / 180.0;
+		float w = 1.0 + 0.1 * (rng() % 50);
+		float h = 0.5 + 0.1 * (rng() % 30);
+		float r = (rng() % 360) * M_PI / 180.0;
 
 		Pnt3f u, v, pos(x, 0.0, z), dir(0.0, 1.0, 0.0), _x(1.0, 0.0, 0.0), _z(0.0, 0.0, 1.0);
 
 		u = cos(r) * _x + sin(-r) * _z;
 		v = sin(r) * _x + cos(r) * _z;
 
-		drawOwO(pos, u, v, pos + dir * h, u * 0.8, v * 0.8, w, w, true);
+		mesh.addBox(pos, u, v, pos + dir * h, u * 0.8, v * 0.8, w, w, true);
 	}
 
-	unsigned tree_amount = 4 + rand() % 8;
+	unsigned tree_amount = 4 + rng() % 8;
 
 	for (int i = 0; i < tree_amount; ++i)
 	{
-		float x = 100.0 - rand() % 200 + 0.01 * (rand() % 100);
-		float z = 100.0 - rand() % 200 + 0.01 * (rand() % 100);
+		float x = 100.0 - rng() % 200 + 0.01 * (rng() % 100);
+		float z = 100.0 - rng() % 200 + 0.01 * (rng() % 100);
 		
-		float w0 = 2.0 + 0.1 * (rand() % 20);
-		float h0 = 4.0 + 0.2 * (rand() % 40);
-		float r = (rand() % 360) * M_PI / 180.0;
-		unsigned n = 2 + rand() % 5;
+		float w0 = 2.0 + 0.1 * (rng() % 20);
+		float h0 = 4.0 + 0.2 * (rng() % 40);
+		float r = (rng() % 360) * M_PI / 180.0;
+		unsigned n = 2 + rng() % 5;
 
 		Pnt3f u, v, pos(x, 0.0, z), dir(0.0, 1.0, 0.0), _x(1.0, 0.0, 0.0), _z(0.0, 0.0, 1.0);
 
 		u = cos(r) * _x + sin(-r) * _z;
 		v = sin(r) * _x + cos(r) * _z;
 
-		if (!doingShadows)
-		{
-			glColor3ub(100, 70, 0);
-		}
+		mesh.color(100, 70, 0);
 
-		drawOwO(pos, u, v, pos + dir * h0, u, v, w0, w0, true);
+		mesh.addBox(pos, u, v, pos + dir * h0, u, v, w0, w0, true);
 
-		if (!doingShadows)
-		{
-			glColor3ub(0, 80, 0);
-		}
+		mesh.color(0, 80, 0);
 
 		for (int j = 0; j < n; ++j)
 		{
-			drawOwO(pos + dir * (h0 * (1.0 + j * 3.0 / n)), u, v, pos + dir * (h0 * (1.0 + (j + 1) * 3.0 / n)), u * (1.0 - ((float) j) / n), v * (1.0 - ((float) j) / n), 2.0 * w0, 2.0 * w0, true);
+			mesh.addBox(pos + dir * (h0 * (1.0 + j * 3.0 / n)), u, v, pos + dir * (h0 * (1.0 + (j + 1) * 3.0 / n)), u * (1.0 - ((float) j) / n), v * (1.0 - ((float) j) / n), 2.0 * w0, 2.0 * w0, true);
 		}
-		// drawOwO(pos + dir * h0, u, v, pos + dir * (h0 + 2), u * 0.0, v * 0.0, 2.0 * w0, 2.0 * w0, true);
+		// mesh.addBox(pos + dir * h0, u, v, pos + dir * (h0 + 2), u * 0.0, v * 0.0, 2.0 * w0, 2.0 * w0, true);
 	}
 }
 // 
@@ -794,7 +1098,12 @@ drawOthers(bool doingShadows)
 //
 // * this tries to see which control point is under the mouse
 //	  (for when the mouse is clicked)
-//		it uses OpenGL picking - which is always a trick
+//		the points are projected into the window once and the picker
+//		takes the nearest one under the mouse - drawing all of them again
+//		in GL_SELECT mode took as long as a frame on a long track
+//		a click on a point selects only it (or keeps the selection if it
+//		is in it, so all of it can be dragged), shift adds it or takes it
+//		out. a click next to the points starts a box, or a lasso with ctrl
 //########################################################################
 // TODO: 
 //		if you want to pick things other than control points, or you
@@ -804,52 +1113,181 @@ drawOthers(bool doingShadows)
 void TrainView::
 doPick()
 //========================================================================
+{
+	projectPoints();
+
+	// where is the mouse? remember: FlTk is upside down!
+	const float mx = (float) Fl::event_x();
+	const float my = (float) (h() - Fl::event_y());
+	const bool shift = (Fl::event_state() & FL_SHIFT) != 0;
+
+	const int hit = picker.pick(mx, my);
+	if (hit < 0) {
+		// nothing hit, what the box or lasso gets is selected
+		selecting = (Fl::event_state() & FL_CTRL) ? Select_Lasso : Select_Box;
+		selectAdd = shift;
+		selectPath.assign(1, mx);
+		selectPath.push_back(my);
+		if (!shift)
+			selectedCube = -1;
+	}
+	else if (shift) {
+		std::vector<int>::iterator at = std::lower_bound(selection.begin(), selection.end(), hit);
+		if (at != selection.end() && *at == hit) {
+			selection.erase(at);
+			selectedCube = -1;
+		}
+		else {
+			selection.insert(at, hit);
+			selectedCube = hit;
+		}
+	}
+	else if (isSelected(hit))
+		selectedCube = hit;
+	else
+		select(hit);
+
+	// DEBUG_INFO("Selected Cube %d\n",selectedCube);
+}
+
+//************************************************************************
+//
+// *
+//========================================================================
+void TrainView::
+endSelecting()
+//========================================================================
+{
+	std::vector<int> found;
+	if (selecting == Select_Lasso)
+		picker.inLasso(selectPath, found);
+	else
+		picker.inBox(selectPath[0], selectPath[1],
+						 selectPath[selectPath.size() - 2], selectPath[selectPath.size() - 1], found);
+	selecting = Select_None;
+
+	if (selectAdd) {
+		std::vector<int> both;
+		std::set_union(selection.begin(), selection.end(), found.begin(), found.end(),
+							std::back_inserter(both));
+		selection.swap(both);
+	}
+	else
+		selection.swap(found);
+
+	if (!isSelected(selectedCube))
+		selectedCube = selection.empty() ? -1 : selection.front();
+	damage(1);
+}
+
+//************************************************************************
+//
+// * with the projection of the view as it is drawn
+//========================================================================
+void TrainView::
+projectPoints()
+//========================================================================
 {
 	// since we'll need to do some GL stuff so we make this window as 
 	// active window
 	make_current();		
 
-	// where is the mouse?
-	int mx = Fl::event_x(); 
-	int my = Fl::event_y();
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	setProjection();
 
-	// get the viewport - most reliable way to turn mouse coords into GL coords
+	double modelview[16], projection[16];
 	int viewport[4];
 	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetDoublev(GL_MODELVIEW_MATRIX, modelview);
+	glGetDoublev(GL_PROJECTION_MATRIX, projection);
 
-	// Set up the pick matrix on the stack - remember, FlTk is
-	// upside down!
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity ();
-	gluPickMatrix((double)mx, (double)(viewport[3]-my), 
-						5, 5, viewport);
+	picker.project(m_pTrack->points, modelview, projection, viewport);
+}
 
-	// now set up the projection
-	setProjection();
+//************************************************************************
+//
+// * the outline of the box or the lasso, in window coordinates
+//========================================================================
+void TrainView::
+drawSelecting()
+//========================================================================
+{
+	const size_t n = selectPath.size();
+	if (n < 4)
+		return;
 
-	// now draw the objects - but really only see what we hit
-	GLuint buf[100];
-	glSelectBuffer(100,buf);
-	glRenderMode(GL_SELECT);
-	glInitNames();
-	glPushName(0);
-
-	// draw the cubes, loading the names as we go
-	for(size_t i=0; i<m_pTrack->points.size(); ++i) {
-		glLoadName((GLuint) (i+1));
-		m_pTrack->points[i].draw();
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glOrtho(0, w(), 0, h(), -1, 1);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+	glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_STENCIL_TEST);
+
+	glColor3ub(240, 240, 30);
+	glBegin(GL_LINE_LOOP);
+	if (selecting == Select_Box) {
+		glVertex2f(selectPath[0], selectPath[1]);
+		glVertex2f(selectPath[n - 2], selectPath[1]);
+		glVertex2f(selectPath[n - 2], selectPath[n - 1]);
+		glVertex2f(selectPath[0], selectPath[n - 1]);
 	}
+	else
+		for (size_t k = 0; k < n; k += 2)
+			glVertex2f(selectPath[k], selectPath[k + 1]);
+	glEnd();
 
-	// go back to drawing mode, and see how picking did
-	int hits = glRenderMode(GL_RENDER);
-	if (hits) {
-		// warning; this just grabs the first object hit - if there
-		// are multiple objects, you really want to pick the closest
-		// one - see the OpenGL manual 
-		// remember: we load names that are one more than the index
-		selectedCube = buf[3]-1;
-	} else // nothing hit, nothing selected
-		selectedCube = -1;
+	glPopAttrib();
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+}
 
-	// DEBUG_INFO("Selected Cube %d\n",selectedCube);
-}
\ No newline at end of file
+//************************************************************************
+//
+// *
+//========================================================================
+void TrainView::
+select(const int point)
+//========================================================================
+{
+	selection.clear();
+	if (point >= 0)
+		selection.push_back(point);
+	selectedCube = point;
+}
+
+//************************************************************************
+//
+// *
+//========================================================================
+bool TrainView::
+isSelected(const int point) const
+//========================================================================
+{
+	return std::binary_search(selection.begin(), selection.end(), point);
+}
+
+//************************************************************************
+//
+// * (a point the mouse had that is gone is the first one, as it was
+//   before there was more than one)
+//========================================================================
+void TrainView::
+keepSelection()
+//========================================================================
+{
+	const int n = (int) m_pTrack->points.size();
+	selection.erase(std::lower_bound(selection.begin(), selection.end(), n), selection.end());
+	if (selectedCube >= n) {
+		selectedCube = 0;
+		if (!isSelected(0))
+			selection.insert(selection.begin(), 0);
+	}
+}
@@ -97,10 +97,21 @@ TrainWindow(const int x, const int y)
 
 		Fl_Button* sub_train = new Fl_Button(605, pty, 60, 20, "-");
 		sub_train->callback((Fl_Callback*)sub_trainCB,this);		
-		trainBox = new Fl_Box(670, pty, 55, 20, "1");
+		carsInput = new Fl_Int_Input(670, pty, 60, 20);
+		carsInput->value("1");
+		carsInput->when(FL_WHEN_ENTER_KEY | FL_WHEN_RELEASE);
+		carsInput->callback((Fl_Callback*)carsCB,this);
 		Fl_Button* add_train = new Fl_Button(735, pty, 60, 20, "+");
 		add_train->callback((Fl_Callback*)add_trainCB,this);		
-		train_amount = 1;
+
+		pty+=25;
+
+		// more trains on the same track
+		Fl_Button* sub_trains = new Fl_Button(605, pty, 60, 20, "- Train");
+		sub_trains->callback((Fl_Callback*)sub_trainsCB,this);
+		trainsBox = new Fl_Box(670, pty, 55, 20, "1");
+		Fl_Button* add_trains = new Fl_Button(735, pty, 60, 20, "+ Train");
+		add_trains->callback((Fl_Callback*)add_trainsCB,this);
 
 		pty+=25;
 
@@ -112,8 +123,10 @@ TrainWindow(const int x, const int y)
 
 		pty += 40;
 
-		arcLength = new Fl_Button(605,pty,190,20,"ArcLength");
+		arcLength = new Fl_Button(605,pty,92,20,"ArcLength");
 		togglify(arcLength,1);
+		brakes = new Fl_Button(703,pty,92,20,"Brakes");
+		togglify(brakes);
 
 		pty += 25;
 
@@ -145,6 +158,16 @@ TrainWindow(const int x, const int y)
 		Fl_Button* dp = new Fl_Button(705,pty,90,20,"Delete Point");
 		dp->callback((Fl_Callback*)deletePointCB,this);
 
+		pty += 25;
+
+		Fl_Button* undo = new Fl_Button(605,pty,60,20,"Undo");
+		undo->callback((Fl_Callback*)undoCB,this);
+		Fl_Button* redo = new Fl_Button(670,pty,60,20,"Redo");
+		redo->callback((Fl_Callback*)redoCB,this);
+		// a command file of edits
+		Fl_Button* edits = new Fl_Button(735,pty,60,20,"Edits");
+		edits->callback((Fl_Callback*)editsCB,this);
+
 		pty += 30;
 
 		// roll the points
@@ -186,6 +209,28 @@ TrainWindow(const int x, const int y)
 		Fl_Button* rng = new Fl_Button(605, pty, 190, 20, "Randomization");
 		rng->callback((Fl_Callback*)rngCB,this);
 
+		pty += 30;
+
+		recordButton = new Fl_Button(605, pty, 92, 20, "Record");
+		togglify(recordButton);
+		recordButton->callback((Fl_Callback*)recordCB,this);
+		replayButton = new Fl_Button(703, pty, 92, 20, "Replay");
+		togglify(replayButton);
+		replayButton->callback((Fl_Callback*)replayCB,this);
+
+		pty += 25;
+
+		clearanceButton = new Fl_Button(605, pty, 190, 20, "Clearance");
+		togglify(clearanceButton);
+
+		pty += 25;
+
+		statsButton = new Fl_Button(605, pty, 92, 20, "Stats");
+		togglify(statsButton);
+		statsCsvButton = new Fl_Button(703, pty, 92, 20, "Stats CSV");
+		togglify(statsCsvButton);
+		statsCsvButton->callback((Fl_Callback*)statsCsvCB,this);
+
 		// TODO: add widgets for all of your fancier features here
 // #ifdef EXAMPLE_SOLUTION
 // 		makeExampleWidgets(this,pty);
@@ -201,6 +246,8 @@ TrainWindow(const int x, const int y)
 
 	// set up callback on idle
 	Fl::add_idle((void (*)(void*))runButtonCB,this);
+
+	publishTrains();
 }
 
 //************************************************************************
@@ -222,11 +269,15 @@ togglify(Fl_Button* b, int val)
 // *
 //========================================================================
 void TrainWindow::
-damageMe()
+damageMe(const unsigned changed)
 //========================================================================
 {
-	if (trainView->selectedCube >= ((int)m_Track.points.size()))
-		trainView->selectedCube = 0;
+	trainView->keepSelection();
+	if (changed & Dirty_Track)
+		m_Track.touch();
+	trainView->invalidate(changed);
+	if (changed & (Dirty_Track | Dirty_Spline | Dirty_Trains))
+		publishTrains();
 	trainView->damage(1);
 }
 
@@ -239,52 +290,44 @@ void TrainWindow::
 advanceTrain(float dir)
 //========================================================================
 {
-	const float x = this->m_Track.trainU;
-	this->origional_speed = dir * ((float)speed->value() * .1f);
-	Pnt3f pos, dir2, up, pos_next;
-
-	this->physics_effected_speed = 0.0;	
-	if (this->physics->value())
+	if (m_Replay.playing())
 	{
-		for (int i = 0; i < this->train_amount; ++i)
-		{
-			this->trainView->getCurvesPoint(this->train_position[i], NULL, &dir2, &up);
-			this->physics_effected_speed += Train_Weight * dir2.y * up.y * -9.8;
-		}
-		this->physics_effected_speed /= this->train_amount;
-	}
-
-	float s = this->origional_speed + this->physics_effected_speed;
-	s = fmod(this->m_Track.points.size() + s, this->m_Track.points.size());
-	if (abs(s) < Min_Speed)
-	{
-		s = Min_Speed * pow(-1.0, signbit(dir));
-	}
-	if (abs(s) > Max_Speed)
-	{
-		s = Max_Speed * pow(-1.0, signbit(dir));
-	}
-
-	if (arcLength->value())
-	{
-		float l = 0.0;
-		for (int i = 0; l <= s && i < this->trainView->m_pTrack->points.size(); i++)
-		{
-			for (int j = 0; l <= s * 75 && j < N_dT; ++j)
-			{
-				const float t0 = fmod(i + x + (j + 0.0) / N_dT, this->trainView->m_pTrack->points.size());
-				const float t1 = fmod(i + x + (j + 1.0) / N_dT, this->trainView->m_pTrack->points.size());
-				this->trainView->getCurvesPoint(t0, &pos, NULL, NULL);
-				this->trainView->getCurvesPoint(t1, &pos_next, NULL, NULL);
-				l += sqrt(pow(pos_next.x - pos.x, 2) + pow(pos_next.y - pos.y, 2) + pow(pos_next.z - pos.z, 2));
-				this->m_Track.trainU += 1.0 / N_dT;
-			}
-		}
+		// backwards is a seek, the recording only runs forward
+		// the recording can change the track and the spline type too
+		const unsigned long revision = m_Track.revision;
+		const int was = splineBrowser->value();
+		int spline = was;
+		const bool more = dir < 0 ? m_Replay.seek(m_Replay.frame() - 1, m_Track, spline, m_Sim)
+										  : m_Replay.next(m_Track, spline, m_Sim);
+		if (!more)
+			runButton->value(0);
+		splineBrowser->select(spline);
+		trainView->invalidate((m_Track.revision != revision ? Dirty_Track : 0) |
+									 (spline != was ? Dirty_Spline : 0));
 	}
 	else
 	{
-		this->m_Track.trainU += s;
+		m_Sim.speed[0] = (float) speed->value();
+		m_Sim.physics = physics->value() != 0;
+		m_Sim.arcLength = arcLength->value() != 0;
+		m_Sim.braking = brakes->value() != 0;
+
+		m_Sim.advance(m_Track, splineBrowser->value(), dir);
+		m_Recorder.tick(m_Sim, m_Track, splineBrowser->value(), dir);
 	}
 
-	this->m_Track.trainU = fmod(this->m_Track.points.size() + this->m_Track.trainU, this->m_Track.points.size());
-}
\ No newline at end of file
+	publishTrains();
+}
+
+//************************************************************************
+//
+// * the sim is the producer of m_Poses, the view the consumer - both on
+//   the FLTK thread for now, but the view never reads the sim for the cars
+//========================================================================
+void TrainWindow::
+publishTrains()
+//========================================================================
+{
+	m_Sim.pose(m_Track, splineBrowser->value(), m_Poses.back());
+	m_Poses.publish();
+}
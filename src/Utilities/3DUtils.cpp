@@ -237,9 +237,18 @@ int getMouseLine(double& x1, double& y1, double& z1,
 								 double& x2, double& y2, double& z2)
 //===============================================================================
 {
-  int x = Fl::event_x();
-  int iy = Fl::event_y();
+  return getMouseLine(Fl::event_x(), Fl::event_y(), x1, y1, z1, x2, y2, z2);
+}
 
+//*************************************************************************
+//
+// * the mouse line at window position x, iy
+//===============================================================================
+int getMouseLine(int x, int iy,
+								 double& x1, double& y1, double& z1,
+								 double& x2, double& y2, double& z2)
+//===============================================================================
+{
   double mat1[16],mat2[16];		// we have to deal with the projection matrices
   int viewport[4];
 
@@ -105,6 +105,10 @@ void unsetupShadows(void);
 // this function gets that ray for you (well, it gets 2 points on the line)
 int getMouseLine(double& p1x, double& p1y, double& p1z,
 								 double& p2x, double& p2y, double& p2z);
+// the same for a mouse position saved from an earlier event
+int getMouseLine(int x, int iy,
+								 double& p1x, double& p1y, double& p1z,
+								 double& p2x, double& p2y, double& p2z);
 			  
 //************************************************************************
 //
@@ -23,7 +23,9 @@
 *************************************************************************/
 
 #include "stdio.h"
+#include "string.h"
 #include "TrainWindow.H"
+#include "Headless.H"
 
 #pragma warning(push)
 #pragma warning(disable:4312)
@@ -32,10 +34,14 @@
 #pragma warning(pop)
 
 
-int main(int, char**)
+int main(int argc, char** argv)
 {
 	printf("CS559 Train Assignment\n");
 
+	// render a scripted sequence offscreen, no window at all
+	if (argc > 2 && !strcmp(argv[1], "--headless"))
+		return runHeadless(argv[2], argc > 3 ? argv[3] : ".");
+
 	TrainWindow tw;
 	tw.show();
 